@@ -0,0 +1,339 @@
+// Microbenchmarks for tinybignum.
+//
+// Every operation is timed at a few operand fill levels, i.e. the share of
+// the bn_array_size words that hold data, and one CSV line is printed per
+// operation and fill level:
+//
+//   op,array_size,word_bits,backend,fill,words,iters,ns_per_op,cycles_per_op
+//
+// The precision is fixed at compile time, so the sweep over bn_array_size
+// is done by `sh make bench`, which builds this file once per size.
+// Cycles are read with rdtsc and count at the TSC's reference rate rather
+// than the core clock, so compare them between runs on the same machine. On
+// targets without rdtsc the column is left empty.
+//
+// Usage: bench [--header] [--min-ms N] [op...]
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+  #define _POSIX_C_SOURCE 199309L
+#endif
+
+#define bn_implementation
+#include <bn.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #include <intrin.h>
+  #define bench__has_cycles 1
+  #define bench__cycles() ((uint64_t)__rdtsc())
+  #define bench__barrier() _ReadWriteBarrier()
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  #include <x86intrin.h>
+  #define bench__has_cycles 1
+  #define bench__cycles() ((uint64_t)__rdtsc())
+#endif
+
+#if !defined(bench__has_cycles)
+  #define bench__has_cycles 0
+  #define bench__cycles() ((uint64_t)0)
+#endif
+
+// Keeps the compiler from hoisting the operation out of the timing loop.
+#if !defined(bench__barrier)
+  #if defined(__GNUC__) || defined(__clang__)
+    #define bench__barrier() __asm__ __volatile__("" ::: "memory")
+  #else
+    #define bench__barrier()
+  #endif
+#endif
+
+#define bench__word_bytes (bn_word_bits/8)
+#define bench__hex_size (bn_array_size*bench__word_bytes*2 + 1)
+#define bench__dec_size (bn_array_size*bench__word_bytes*3 + 1)
+
+static Bignum a, b, r, q, m, e, ma, mb;
+static BignumMont mont;
+static char hex[bench__hex_size];
+static char dec[bench__dec_size];
+static uint64_t rng_state = 0x9e3779b97f4a7c15u;
+
+static double bench__now_ns(void)
+{
+#if defined(_WIN32)
+  LARGE_INTEGER freq, t;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+#endif
+}
+
+static uint64_t bench__rand(void)
+{
+  uint64_t x = rng_state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  rng_state = x;
+  return x;
+}
+
+// Sets n to a random value of exactly `words` words.
+static void bench__fill(Bignum* n, int words)
+{
+  uint8_t bytes[bn_array_size*bench__word_bytes];
+  size_t size = (size_t)words * bench__word_bytes;
+  size_t i;
+  for(i = 0; i < size; ++i) {
+    bytes[i] = (uint8_t)bench__rand();
+  }
+  bytes[size-1] |= 0x80;
+  bignum_from_bytes(n, bytes, size, 0);
+}
+
+static void bench_add(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_add(&r, &a, &b);
+    bench__barrier();
+  }
+}
+
+static void bench_sub(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_sub(&r, &a, &b);
+    bench__barrier();
+  }
+}
+
+static void bench_mul(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_mul(&r, &a, &b);
+    bench__barrier();
+  }
+}
+
+static void bench_sqr(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_sqr(&r, &a);
+    bench__barrier();
+  }
+}
+
+static void bench_divmod(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_divmod(&q, &r, &a, &m);
+    bench__barrier();
+  }
+}
+
+static void bench_to_hex(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    hex_from_bignum(&a, hex, bench__hex_size);
+    bench__barrier();
+  }
+}
+
+static void bench_from_hex(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_from_hex(&r, hex, bench__hex_size);
+    bench__barrier();
+  }
+}
+
+static void bench_to_dec(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    dec_from_bignum(&a, dec, bench__dec_size);
+    bench__barrier();
+  }
+}
+
+static void bench_from_dec(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_from_dec(&r, dec, bench__dec_size);
+    bench__barrier();
+  }
+}
+
+static void bench_gcd(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_gcd(&r, &a, &b);
+    bench__barrier();
+  }
+}
+
+static void bench_mont_mul(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_mont_mul(&r, &ma, &mb, &mont);
+    bench__barrier();
+  }
+}
+
+static void bench_modexp(long iters)
+{
+  long i;
+  for(i = 0; i < iters; ++i) {
+    bignum_modexp(&r, &ma, &e, &mont);
+    bench__barrier();
+  }
+}
+
+typedef struct Bench Bench;
+struct Bench
+{
+  char const* name;
+  void (*run)(long iters);
+};
+
+static Bench const benches[] = {
+  {"add",      bench_add},
+  {"sub",      bench_sub},
+  {"mul",      bench_mul},
+  {"sqr",      bench_sqr},
+  {"divmod",   bench_divmod},
+  {"to_hex",   bench_to_hex},
+  {"from_hex", bench_from_hex},
+  {"to_dec",   bench_to_dec},
+  {"from_dec", bench_from_dec},
+  {"gcd",      bench_gcd},
+  {"mont_mul", bench_mont_mul},
+  {"modexp",   bench_modexp},
+};
+
+static int const fills[] = {25, 50, 100};
+
+// Sets up the operands for `words` words. a and b are full-size values,
+// m is an odd divisor of half their size (at least one word), and ma and mb
+// are a and b reduced modulo the odd full-size Montgomery modulus, with e
+// being a full-size exponent.
+static void bench__setup(int words)
+{
+  int half = words > 1 ? words/2 : 1;
+  bench__fill(&a, words);
+  bench__fill(&b, words);
+  bench__fill(&m, half);
+  bench__fill(&e, words);
+  bench__fill(&q, words);
+  m.array[0] |= 1;
+  q.array[0] |= 1;
+  bignum_mont_init(&mont, &q);
+  bignum_divmod(&r, &ma, &a, &q);
+  bignum_divmod(&r, &mb, &b, &q);
+  hex_from_bignum(&a, hex, bench__hex_size);
+  dec_from_bignum(&a, dec, bench__dec_size);
+}
+
+static void bench__measure(Bench const* bench, int fill, int words, double min_ns)
+{
+  long iters = 1;
+  double ns;
+  uint64_t cycles;
+  for(;;) {
+    double t0 = bench__now_ns();
+    uint64_t c0 = bench__cycles();
+    bench->run(iters);
+    cycles = bench__cycles() - c0;
+    ns = bench__now_ns() - t0;
+    if(ns >= min_ns || iters >= (1L << 30)) {
+      break;
+    }
+    // Aim a bit past the target so that the next round is usually the last.
+    if(ns*8 < min_ns) {
+      iters *= 8;
+    }
+    else {
+      iters = (long)((double)iters * min_ns * 1.25 / ns) + 1;
+    }
+  }
+  printf("%s,%d,%d,%s,%d,%d,%ld,%.2f,", bench->name, bn_array_size, bn_word_bits,
+    bignum_cpu_backend(), fill, words, iters, ns / (double)iters);
+  if(bench__has_cycles) {
+    printf("%.1f", (double)cycles / (double)iters);
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+static int bench__selected(char const* name, int argc, char** argv, int first_op)
+{
+  int i;
+  if(first_op == argc) {
+    return 1;
+  }
+  for(i = first_op; i < argc; ++i) {
+    if(strcmp(argv[i], name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  double min_ns = 20e6;
+  int first_op = 1;
+  size_t i, j;
+
+  while(first_op < argc && argv[first_op][0] == '-') {
+    if(strcmp(argv[first_op], "--header") == 0) {
+      printf("op,array_size,word_bits,backend,fill,words,iters,ns_per_op,cycles_per_op\n");
+      first_op += 1;
+    }
+    else if(strcmp(argv[first_op], "--min-ms") == 0 && first_op+1 < argc) {
+      min_ns = atof(argv[first_op+1]) * 1e6;
+      first_op += 2;
+    }
+    else {
+      fprintf(stderr, "usage: %s [--header] [--min-ms N] [op...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  bignum_init_cpu();
+  for(j = 0; j < sizeof fills / sizeof fills[0]; ++j) {
+    int words = bn_array_size * fills[j] / 100;
+    if(words < 1) {
+      words = 1;
+    }
+    bench__setup(words);
+    for(i = 0; i < sizeof benches / sizeof benches[0]; ++i) {
+      if(bench__selected(benches[i].name, argc, argv, first_op)) {
+        bench__measure(&benches[i], fills[j], words, min_ns);
+      }
+    }
+  }
+  return 0;
+}
@@ -10,6 +10,7 @@ Licence: public domain.
 
 *****************************************************************************/
 
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -26,8 +27,45 @@ Licence: public domain.
   #error "bn_array_size must be at least 2"
 #endif
 
-#define bn_word_msb (UINT64_C(0x80000000))
-#define bn_max_val  (UINT64_C(0xFFFFFFFF))
+#ifndef bn_karatsuba_threshold
+  #define bn_karatsuba_threshold 24
+#endif
+
+#if bn_karatsuba_threshold < 4
+  #error "bn_karatsuba_threshold must be at least 4"
+#endif
+
+#ifndef bn_modexp_max_window
+  #define bn_modexp_max_window 5
+#endif
+
+#ifndef bn_thread_local
+  #define bn_thread_local
+#endif
+
+#if bn_modexp_max_window < 1 || bn_modexp_max_window > 8
+  #error "bn_modexp_max_window must be between 1 and 8"
+#endif
+
+#ifndef bn_word_bits
+  #define bn_word_bits 32
+#endif
+
+#if defined(bn_constant_time) && defined(bn_track_length)
+  #error "bn_constant_time can't be used together with bn_track_length"
+#endif
+
+#if bn_word_bits == 32
+  typedef uint32_t bn_word;
+  #define bn_word_msb (UINT64_C(0x80000000))
+  #define bn_max_val  (UINT64_C(0xFFFFFFFF))
+#elif bn_word_bits == 64
+  typedef uint64_t bn_word;
+  #define bn_word_msb (UINT64_C(0x8000000000000000))
+  #define bn_max_val  (UINT64_C(0xFFFFFFFFFFFFFFFF))
+#else
+  #error "bn_word_bits must be either 32 or 64"
+#endif
 
 #if defined(bn_test)
   #define bn_extern __declspec(dllexport) extern
@@ -40,7 +78,10 @@ Licence: public domain.
 typedef struct Bignum Bignum;
 struct Bignum
 {
-  uint32_t array[bn_array_size];
+  bn_word array[bn_array_size];
+#if defined(bn_track_length)
+  int length;
+#endif
 };
 
 /*****************************************************************************
@@ -59,8 +100,10 @@ struct Bignum
 
   3. `bignum_from_hex`
     Takes  a  string  with  HEX  representation  of  a bignum, and initializes
-    a  Bignum variable with the value encoded in the string. The string has to
-    be multiple of 8 characters.
+    a  Bignum variable with the value encoded in the string. Both lower and
+    upper  case  digits  are  accepted.  Other  characters are caught by
+    bn_assert,  if  it's  disabled the string is trusted to be well-formed
+    and isn't checked.
 
     No  more  than `maxsize` bytes are guaranteed to be read. If length of the
     string is less than maxsize, no more than that length is read.
@@ -68,14 +111,37 @@ struct Bignum
     If the value represented by the string is bigger than fits in bignum array
     then the overflow flag is set.
 
-  4. `bignum_assign`
+  4. `bignum_from_dec`
+    Same  as  `bignum_from_hex`,  but  for  a  string  of  decimal digits of
+    any  length.  If  the  value  doesn't  fit,  the  overflow  flag is set
+    and  the  value  is  truncated  to  the  lowest  bits. Long strings are
+    converted  by  splitting them in halves, which is subquadratic for big
+    values of bn_array_size.
+
+  5. `bignum_from_bytes`
+    Takes  `size`  bytes  of  the  unsigned binary representation of a value,
+    with  the  least  significant  byte  first,  or  the most significant
+    first  if  `big_endian`  is  non-zero. If the value doesn't fit, the
+    overflow  flag  is  set  and  it's  truncated to the lowest bytes. On
+    little-endian hosts the little-endian format is a copy of `array`.
+
+  6. `bignum_assign`
     Takes  initalized  `src`  Bignum, and copies it's value to `dst` variable,
     initializing it.
 
+  If  the  macro  `bn_track_length`  is  defined,  Bignum  also  caches the
+  number of its significant words, and all operations only loop over those.
+  In that mode every Bignum has to be initialized with one of the functions
+  above (or with `{0}`) before being passed to any other function, including
+  as  the result. Code that writes the `array` directly has to keep the
+  words past `length` zero and `length` up to date.
+
 *****************************************************************************/
 bn_extern void bignum_init(Bignum* n);
 bn_extern void bignum_from_u64(Bignum* n, uint64_t i);
 bn_extern void bignum_from_hex(Bignum* n, char const* str, int maxsize);
+bn_extern void bignum_from_dec(Bignum* n, char const* str, int maxsize);
+bn_extern void bignum_from_bytes(Bignum* n, uint8_t const* bytes, size_t size, int big_endian);
 bn_extern void bignum_assign(Bignum* dst, Bignum const* src);
 
 
@@ -89,13 +155,27 @@ bn_extern void bignum_assign(Bignum* dst, Bignum const* src);
     overflow flag see the section below.
 
   2. `hex_from_bignum`
-    Takes  a  finite  string  of  hex  digits  and  converts  it  to a bignum.
+    Writes the value of the bignum as maxsize-1 lower case hex digits to `str`.
     The digits will be written in the big-endian format, with the lowest-order
     digit  necessarily  being  written  in the (maxsize-2)'nd character of the
-    string. `maxsize` must count the null-terminator.
+    string,  padded  with  zeros  or  cut  at  the  top  to  fit.  `maxsize`
+    must count the null-terminator.
+
+  3. `dec_from_bignum`
+    Writes  the decimal digits of the Bignum, without leading zeros, to `str`
+    and  terminates  it  with  null. Returns the number of digits of the full
+    number.  If  that's  not less than `maxsize`, only the first maxsize-1
+    digits are written.
+
+  4. `bytes_from_bignum`
+    Writes  the  value  as  exactly  `size`  bytes in the same format that
+    `bignum_from_bytes`  takes, padded with zeros. If the value needs more
+    bytes, it's cut to the lowest ones and the overflow flag is set.
 *****************************************************************************/
 bn_extern uint64_t u64_from_bignum(Bignum const* n);
 bn_extern void hex_from_bignum(Bignum const* n, char* str, int maxsize);
+bn_extern int dec_from_bignum(Bignum const* n, char* str, int maxsize);
+bn_extern void bytes_from_bignum(Bignum const* n, uint8_t* bytes, size_t size, int big_endian);
 
 
 /*****************************************************************************
@@ -108,6 +188,12 @@ bn_extern void hex_from_bignum(Bignum const* n, char* str, int maxsize);
   2. `bignum_is_overflow`
     Returns the value of the overflow flag. Zero, if the overflow wasn't
       occured, and non-zero value if it has.
+
+  By  default  the  overflow flag is shared by all threads. Define the macro
+  `bn_thread_local`  to  the  thread-local storage specifier of your compiler
+  (`_Thread_local`, `thread_local`, `__thread`, `__declspec(thread)`) to give
+  every thread its own flag. Alternatively, use the `_ex` family of arithmetic
+  functions, which don't touch the flag at all.
 *****************************************************************************/
 bn_extern void bignum_reset_overflow_flag(void);
 bn_extern int bignum_is_overflow(void);
@@ -149,6 +235,38 @@ bn_extern int  bignum_equal(Bignum const* a, Bignum const* b);
 bn_extern int  bignum_is_zero(Bignum const* n);
 
 
+/*****************************************************************************
+  Constant-time functions
+
+  1. `bignum_cmov`
+    Copies  `a`  to  `r`  if  `cond`  is non-zero, otherwise leaves `r` as it
+    is.
+
+  2. `bignum_cswap`
+    Swaps the values of `a` and `b` if `cond` is non-zero.
+
+  Both  functions go over the whole array and select the words with masks,
+  so the time they take depends neither on `cond` nor on the values.
+
+  If  the macro `bn_constant_time` is defined, the same holds for the
+  comparison  functions,  the  arithmetic  functions,  `bignum_divmod` and
+  the Montgomery functions. In that mode
+  - the operands are always processed over all bn_array_size words, which
+    is why `bn_track_length` can't be defined along with it;
+  - words  are  divided one bit at a time instead of with the division
+    instruction, whose timing depends on the operands on many processors;
+  - `bignum_modexp`  uses the Montgomery ladder over all bits of the exponent
+    array,  one  multiplication  and one squaring per bit, instead of the
+    sliding window.
+  The  number  of significant words of the modulus and of the divisor
+  of  `bignum_divmod`  is not hidden, and neither are the string conversion
+  functions. The functions that set the overflow flag branch on it, use the
+  `_ex` variants if that matters.
+*****************************************************************************/
+bn_extern void bignum_cmov(Bignum* r, Bignum const* a, int cond);
+bn_extern void bignum_cswap(Bignum* a, Bignum* b, int cond);
+
+
 /*****************************************************************************
   Arithmetic functions
   
@@ -156,7 +274,7 @@ bn_extern int  bignum_is_zero(Bignum const* n);
   as the left-hand side operand of the corresponding operation.
 
   If the result of the operation overflows (becomes unrepresentable by current
-  size), for example being higher than 2**(4*bn_array_size), or less than zero
+  size), for example being higher than 2**(bn_word_bits*bn_array_size), or less than zero
   then  the overflow flag is set, and you can check it with bignum_is_overflow
   function.
 
@@ -174,17 +292,610 @@ bn_extern int  bignum_is_zero(Bignum const* n);
 
   5. `bignum_mul`
     Multiplies  the numbers `b` and `c` and stores the resulting value in `a`.
+    If  both  operands  have  at  least `bn_karatsuba_threshold` significant
+    words, Karatsuba multiplication is used, otherwise the schoolbook one.
+    The Karatsuba path takes about 10*bn_array_size words of stack space.
+
+  6. `bignum_sqr`
+    Squares the number `b` and stores the resulting value in `a`. This is
+    about twice as fast as `bignum_mul(a, b, b)`.
 
-  6. `bignum_div`
+  7. `bignum_divmod`
     Divides the numbers `a` by `b`, stores the quotient of the division in
-    `q`, and the remainder in `r`.
+    `q`, and the remainder in `r`. Both `q` and `r` may alias the operands,
+    but not each other. The division takes O(n*m) word operations, where n
+    and m are the numbers of significant words in `a` and `b`.
+
+  8. `bignum_add_u32`
+    Adds the small value `c` to `b` and stores the result in `a`.
+
+  9. `bignum_mul_u32`
+    Multiplies  `b`  by  the small value `c` and stores the result in `a`.
+    This  makes  a  single  pass  over  `b`,  without  building  a Bignum
+    for `c` and going through `bignum_mul`.
+
+  10. `bignum_divmod_u32`
+    Divides  `a`  by  the small non-zero value `b`, stores the quotient in
+    `q`, which may alias `a`, and returns the remainder.
+
+  11. `bignum_muladd`
+    Stores  b*c + d  to  `a`.  The rows of the product are added straight
+    into a copy of `d`, so it takes one pass and no temporary for the
+    product. `a` may alias any of the operands.
+
+  12. `bignum_addmul_u32`
+    Adds  b*c  to `a`, where `c` is a small value, in a single pass. `a`
+    may be the same as `b`.
+
+  13. `bignum_mul_wide`
+    Computes  the  full  product  of  `a`  and  `b`,  which  has  up  to
+    2*bn_array_size words, and stores its low half in `lo` and its high
+    half  in  `hi`,  so  it never overflows. `lo` and `hi` may alias the
+    operands, but not each other.
+
+  The  functions  `bignum_incr_ex`,  `bignum_decr_ex`,  `bignum_add_ex`,
+  `bignum_sub_ex`,  `bignum_mul_ex`,  `bignum_sqr_ex`, `bignum_add_u32_ex`,
+  `bignum_mul_u32_ex`,  `bignum_muladd_ex` and `bignum_addmul_u32_ex` do
+  the  same  as  the  corresponding functions above, but instead of
+  setting the overflow flag they return the final carry (or borrow), or
+  non-zero value if the product didn't fit. For `bignum_mul_u32_ex` and
+  `bignum_addmul_u32_ex`  that value is the word that was carried out of the
+  top. The regular functions only write the flag when an overflow occurs.
 *****************************************************************************/
 bn_extern void bignum_incr(Bignum* n);
 bn_extern void bignum_decr(Bignum* n);
 bn_extern void bignum_add(Bignum* a, Bignum const* b, Bignum const* c);
 bn_extern void bignum_sub(Bignum* a, Bignum const* b, Bignum const* c);
 bn_extern void bignum_mul(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern void bignum_sqr(Bignum* a, Bignum const* b);
 bn_extern void bignum_divmod(Bignum* q, Bignum *r, Bignum const* a, Bignum const* b);
+bn_extern void bignum_add_u32(Bignum* a, Bignum const* b, uint32_t c);
+bn_extern void bignum_mul_u32(Bignum* a, Bignum const* b, uint32_t c);
+bn_extern uint32_t bignum_divmod_u32(Bignum* q, Bignum const* a, uint32_t b);
+bn_extern void bignum_muladd(Bignum* a, Bignum const* b, Bignum const* c, Bignum const* d);
+bn_extern void bignum_addmul_u32(Bignum* a, Bignum const* b, uint32_t c);
+bn_extern void bignum_mul_wide(Bignum* lo, Bignum* hi, Bignum const* a, Bignum const* b);
+
+bn_extern uint32_t bignum_incr_ex(Bignum* n);
+bn_extern uint32_t bignum_decr_ex(Bignum* n);
+bn_extern uint32_t bignum_add_ex(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern uint32_t bignum_sub_ex(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern uint32_t bignum_mul_ex(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern uint32_t bignum_sqr_ex(Bignum* a, Bignum const* b);
+bn_extern uint32_t bignum_add_u32_ex(Bignum* a, Bignum const* b, uint32_t c);
+bn_extern uint32_t bignum_mul_u32_ex(Bignum* a, Bignum const* b, uint32_t c);
+bn_extern uint32_t bignum_muladd_ex(Bignum* a, Bignum const* b, Bignum const* c, Bignum const* d);
+bn_extern uint32_t bignum_addmul_u32_ex(Bignum* a, Bignum const* b, uint32_t c);
+
+/*****************************************************************************
+  Bitwise functions
+
+  The result pointer may point to the same object as any of the operands.
+
+  1. `bignum_lshift`
+    Shifts  `b`  left  by  `nbits`  bits  and  stores the result in `a`. If
+    any non-zero bits are shifted out of the top, the overflow flag is set.
+
+  2. `bignum_rshift`
+    Shifts  `b`  right  by  `nbits`  bits  and  stores the result in `a`.
+
+  3. `bignum_and`, `bignum_or`, `bignum_xor`
+    Store the bitwise and, or or xor of `b` and `c` in `a`.
+
+  4. `bignum_not`
+    Stores  the  bitwise  complement  of  `b`  with respect to all
+    bn_word_bits*bn_array_size bits to `a`.
+
+  5. `bignum_bit_length`
+    Returns the number of bits needed to represent `n`, which is the index of
+    its highest set bit plus one, or 0 if `n` is zero.
+
+  Shift amounts may be any non-negative number, everything is shifted out if
+  it's not less than bn_word_bits*bn_array_size. Whole words are moved at
+  once, only the remaining bits are shifted within the words.
+*****************************************************************************/
+bn_extern void bignum_lshift(Bignum* a, Bignum const* b, int nbits);
+bn_extern void bignum_rshift(Bignum* a, Bignum const* b, int nbits);
+bn_extern void bignum_and(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern void bignum_or(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern void bignum_xor(Bignum* a, Bignum const* b, Bignum const* c);
+bn_extern void bignum_not(Bignum* a, Bignum const* b);
+bn_extern int  bignum_bit_length(Bignum const* n);
+
+/*****************************************************************************
+  GCD and modular inverse
+
+  The result pointer may point to the same object as any of the operands.
+
+  1. `bignum_gcd`
+    Stores  the  greatest  common  divisor of `a` and `b` to `res`. The gcd
+    of  zero  and  x  is  x.  Uses  the binary algorithm: the factors of two
+    are shifted out whole words and bit counts at a time, and the smaller
+    odd value is subtracted from the larger one, no division is done.
+
+  2. `bignum_lcm`
+    Stores the least common multiple of `a` and `b` to `res`, which is zero
+    if either of them is. If it doesn't fit, the overflow flag is set.
+
+  3. `bignum_modinv`
+    Stores  the  inverse  of `a` modulo the non-zero `m` to `res` and returns
+    non-zero  value,  if  `a`  and  `m`  are  coprime.  Otherwise stores zero
+    and returns zero. `a` may be greater than `m`. Uses the extended Euclidean
+    algorithm.
+
+    In  constant-time  mode,  if `m` is odd, a binary algorithm with a fixed
+    number  of  steps  is used instead, in the spirit of Bernstein and Yang's
+    safegcd. Each step subtracts and halves with masks, and there are always
+    2*bn_word_bits*k of them, where k is the number of significant words of
+    `m`. That makes it several times slower than the Euclidean algorithm.
+*****************************************************************************/
+bn_extern void bignum_gcd(Bignum* res, Bignum const* a, Bignum const* b);
+bn_extern void bignum_lcm(Bignum* res, Bignum const* a, Bignum const* b);
+bn_extern int  bignum_modinv(Bignum* res, Bignum const* a, Bignum const* m);
+
+/*****************************************************************************
+  Roots
+
+  The result pointer may point to the same object as the operand.
+
+  1. `bignum_isqrt`
+    Stores  floor(sqrt(a))  to `res`. Uses Newton's iteration, starting from
+    a  power  of  two  taken  from  the  bit  length  of  `a`,  which  is at
+    most  twice  too  big. The number of steps is logarithmic in the
+    bit length, every step takes one `bignum_divmod`.
+
+  2. `bignum_iroot`
+    Stores the `k`th root of `a`, rounded down, to `res`. `k` must be at least
+    1.  Same  as  `bignum_isqrt`,  but every step also computes the (k-1)th
+    power of the estimate.
+
+  3. `bignum_is_square`
+    Returns  non-zero  value  if  `a`  is  a perfect square. Most non-squares
+    are rejected by their residues modulo 64 and a few small primes, taken
+    with  one  `bignum_divmod_u32`,  only  the  rest  take  a  square  root.
+*****************************************************************************/
+bn_extern void bignum_isqrt(Bignum* res, Bignum const* a);
+bn_extern void bignum_iroot(Bignum* res, Bignum const* a, int k);
+bn_extern int  bignum_is_square(Bignum const* a);
+
+/*****************************************************************************
+  Primes
+
+  These  functions  are  not  constant-time,  even  with `bn_constant_time`,
+  they branch on the number being tested. A false result is always right, a
+  true one is right unless the number is a pseudoprime to every base tried.
+
+  1. `bignum_is_probable_prime`
+    Returns  non-zero  value  if  `n`  is  prime  or a strong pseudoprime to
+    `rounds`  Miller-Rabin  bases.  `n` is first divided by the odd primes
+    below 2048, a few at a time with one pass over the words for every group
+    that  fits  a  word,  which  finds  most  composites and decides values
+    below 2048**2. The bases are 2 and the odd primes from 3 up, `rounds` is
+    between  1  and  309.  Fixed bases can be fooled by composites made for
+    them,  for  numbers  from  untrusted sources also run `bignum_miller_rabin`
+    with random bases.
+
+  2. `bignum_miller_rabin`
+    One  round  of  Miller-Rabin  on  the  odd  `n`  greater than 3. Returns
+    non-zero  value  if  `n`  is  a strong probable prime to `base`, a base
+    that is 0, 1 or -1 modulo `n` passes every number.
+
+  3. `bignum_next_prime`
+    Stores  the  smallest  probable prime greater than `a` to `res`, using
+    `rounds`  as  `bignum_is_probable_prime`  does. The candidates are sieved
+    by  the  small  primes  in  windows of 2048 numbers, the residues of the
+    window  are  updated  from  the  previous one, so only the first window
+    divides  the  number.  If there's no prime before the top of the range
+    `res` is set to 0 and the overflow flag is set. `res` may be `a`.
+*****************************************************************************/
+bn_extern int  bignum_is_probable_prime(Bignum const* n, int rounds);
+bn_extern int  bignum_miller_rabin(Bignum const* n, Bignum const* base);
+bn_extern void bignum_next_prime(Bignum* res, Bignum const* a, int rounds);
+
+/*****************************************************************************
+  Modular arithmetic
+
+  Montgomery  arithmetic  works  on  values  in  Montgomery  form, a*R mod m,
+  where  R = 2**(bn_word_bits*k) and k is the number of significant words of the odd
+  modulus m. The BignumMont context holds the precomputed constants for one
+  modulus, it is filled once and can then be reused for any number of calls.
+  All  values  passed  to  the  functions below must be less than m, except
+  for the argument of `bignum_to_mont` and the exponent of `bignum_modexp`.
+
+  1. `bignum_mont_init`
+    Fills  `ctx`  for  the  modulus `m`. The modulus has to be odd. Computes
+    -m**-1 mod 2**bn_word_bits and R**2 mod m.
+
+  2. `bignum_to_mont`
+    Converts  `a`  to  Montgomery  form  and  stores  the  result in `res`.
+    `a` may be greater than the modulus, in that case it's reduced first.
+
+  3. `bignum_from_mont`
+    Converts  `a`  from  Montgomery  form  and  stores  the result in `res`.
+
+  4. `bignum_mont_mul`
+    Stores  a*b/R  mod  m  to  `res`.  If both operands are in Montgomery form,
+    so is the result.
+
+  5. `bignum_mont_sqr`
+    Stores a*a/R mod m to `res`. Uses the squaring kernel, so it's cheaper than
+    `bignum_mont_mul(res, a, a, ctx)`.
+
+  6. `bignum_modexp`
+    Stores  base**exp  mod m to `res`. `base` and `res` are in normal form.
+    Uses  sliding  window  exponentiation  with  windows  of  up  to
+    `bn_modexp_max_window` bits. The table of odd powers of `base` is kept on
+    the stack and takes 2**(bn_modexp_max_window-1) bignums.
+
+  The result pointers are allowed to alias the operands.
+*****************************************************************************/
+typedef struct BignumMont BignumMont;
+struct BignumMont
+{
+  Bignum modulus;
+  Bignum r2;
+  bn_word minv;
+  int ndigits;
+};
+
+bn_extern void bignum_mont_init(BignumMont* ctx, Bignum const* m);
+bn_extern void bignum_to_mont(Bignum* res, Bignum const* a, BignumMont const* ctx);
+bn_extern void bignum_from_mont(Bignum* res, Bignum const* a, BignumMont const* ctx);
+bn_extern void bignum_mont_mul(Bignum* res, Bignum const* a, Bignum const* b, BignumMont const* ctx);
+bn_extern void bignum_mont_sqr(Bignum* res, Bignum const* a, BignumMont const* ctx);
+bn_extern void bignum_modexp(Bignum* res, Bignum const* base, Bignum const* exp, BignumMont const* ctx);
+
+/*****************************************************************************
+  Fixed-base exponentiation
+
+  When  the  same  base  is raised to many exponents modulo the same m, the
+  powers  base**(d*2**(k*w))  for  every  window  k  of  w  bits and every
+  non-zero  digit d can be computed once. An exponentiation then takes one
+  Montgomery  multiplication  per  non-zero window of the exponent and no
+  squarings. The table is kept in a buffer supplied by the caller, and the
+  BignumFixedBase  points  to  it  and  to the Montgomery context, so both
+  have to outlive it.
+
+  1. `bignum_fixed_base_words`
+    Returns  the  number  of  words  the table takes for exponents of up to
+      `ebits`  bits  with  windows  of  `window`  bits,  which  is
+      ceil(ebits/window)*(2**window - 1)*k  for  a  modulus  of k words.
+      Aligning the buffer to a cache line keeps the entries in as few lines
+      as possible.
+
+  2. `bignum_fixed_base_init`
+    Fills  `table`  with  the  powers  of  `base`,  which may be greater than
+      the modulus, and `fb` with the parameters. `window` has to be between 1
+      and 8. Takes one multiplication per table entry.
+
+  3. `bignum_fixed_base_exp`
+    Stores  base**exp  mod  m  to  `res`. `exp` can have at most `ebits` bits.
+      In constant-time mode every window takes a multiplication, the entry
+      is selected by scanning the whole row of the table.
+*****************************************************************************/
+typedef struct BignumFixedBase BignumFixedBase;
+struct BignumFixedBase
+{
+  BignumMont const* ctx;
+  bn_word const* table;
+  int ebits;
+  int window;
+};
+
+bn_extern size_t bignum_fixed_base_words(BignumMont const* ctx, int ebits, int window);
+bn_extern void bignum_fixed_base_init(BignumFixedBase* fb, Bignum const* base, int ebits, int window,
+                                      BignumMont const* ctx, bn_word* table);
+bn_extern void bignum_fixed_base_exp(Bignum* res, Bignum const* exp, BignumFixedBase const* fb);
+
+/*****************************************************************************
+  Barrett reduction
+
+  Barrett  reduction  replaces the division by a fixed modulus m, which may
+  be even, with two multiplications. The BignumBarrett context holds
+  mu = floor(B**(2k)/m),  where  B = 2**bn_word_bits and k is the number of
+  significant words of m. It is filled once and can be reused for any number
+  of calls.
+
+  1. `bignum_barrett_init`
+    Fills `ctx` for the non-zero modulus `m`.
+
+  2. `bignum_barrett_reduce`
+    Stores  a  mod  m  to  `res`.  Values  of up to 2k words take one pass,
+    bigger ones are reduced k words at a time from the top.
+
+  3. `bignum_barrett_mulmod`
+    Stores  a*b  mod  m  to  `res`,  where  `a` and `b` are less than m. The
+    full double-length product is reduced, so it doesn't overflow even if
+    2k is greater than bn_array_size.
+
+  The result pointers are allowed to alias the operands.
+*****************************************************************************/
+typedef struct BignumBarrett BignumBarrett;
+struct BignumBarrett
+{
+  Bignum modulus;
+  bn_word mu[bn_array_size+2];
+  int ndigits;
+  int mudigits;
+};
+
+bn_extern void bignum_barrett_init(BignumBarrett* ctx, Bignum const* m);
+bn_extern void bignum_barrett_reduce(Bignum* res, Bignum const* a, BignumBarrett const* ctx);
+bn_extern void bignum_barrett_mulmod(Bignum* res, Bignum const* a, Bignum const* b, BignumBarrett const* ctx);
+
+/*****************************************************************************
+  Limb spans
+
+  These  functions  work  on  caller-owned  arrays  of  words,  the  least
+  significant  word  first,  with  the length passed next to each array.
+  They are the kernels the Bignum functions above are built on, so values
+  of  different  sizes  can be kept in arrays of just the words they need,
+  and  a  Bignum  is  its  `array`  with  n = bn_array_size. They don't
+  touch the overflow flag. All lengths must be at least 1. The operands
+  of  `bignum_span_mul`  and  `bignum_span_sqr`  and  the  divisor  of
+  `bignum_span_divmod`  may  be up to bn_array_size words long, which
+  sizes the scratch space they take from the stack. In constant-time mode
+  the time only depends on the lengths.
+
+  1. `bignum_span_cmp`
+    Compares  a[0..an)  and b[0..bn), returns -1, 0 or 1. The lengths
+    may differ and the top words may be zero.
+
+  2. `bignum_span_add`, `bignum_span_sub`
+    Store  a + b  or  a - b  to r[0..an), where an >= bn, and return the
+    carry  or  the  borrow  out  of  the top word. `r` may be the same as
+    `a` or `b`.
+
+  3. `bignum_span_mul`
+    Stores  the full product to r[0..an+bn). `r` must not overlap the
+    operands.
+
+  4. `bignum_span_sqr`
+    Stores a*a to r[0..2n). `r` must not overlap `a`.
+
+  5. `bignum_span_divmod`
+    Divides  a[0..an) by b[0..bn), where an >= bn and the top word of `b`
+    is  non-zero.  The  quotient  is  stored to q[0..an-bn] and the
+    remainder  to r[0..bn). The dividend may be up to 2*bn_array_size+1
+    words long. `q` and `r` may be the same as `a` or `b`, but must not
+    overlap each other.
+
+  6. `bignum_span_lshift`, `bignum_span_rshift`
+    Store  a[0..n)  shifted  by `nbits` to r[0..n), where 0 <= nbits <
+    bn_word_bits.  `bignum_span_lshift` returns the bits shifted out of
+    the top. `r` may be the same as `a`.
+
+  7. `bignum_span_addmul_1`, `bignum_span_submul_1`
+    Add  b*a[0..n)  to  r[0..n)  or  subtract  it,  and  return  the word
+    to be carried into or borrowed from r[n]. These are the inner loops of
+    the  multiplications,  the  division  and  the  Montgomery reduction,
+    with the ADX kernel when it's selected. `r` may be the same as `a`.
+*****************************************************************************/
+bn_extern int     bignum_span_cmp(bn_word const* a, int an, bn_word const* b, int bn);
+bn_extern bn_word bignum_span_add(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn);
+bn_extern bn_word bignum_span_sub(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn);
+bn_extern void    bignum_span_mul(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn);
+bn_extern void    bignum_span_sqr(bn_word* r, bn_word const* a, int n);
+bn_extern void    bignum_span_divmod(bn_word* q, bn_word* r, bn_word const* a, int an, bn_word const* b, int bn);
+bn_extern bn_word bignum_span_lshift(bn_word* r, bn_word const* a, int n, int nbits);
+bn_extern void    bignum_span_rshift(bn_word* r, bn_word const* a, int n, int nbits);
+bn_extern bn_word bignum_span_addmul_1(bn_word* r, bn_word const* a, int n, bn_word b);
+bn_extern bn_word bignum_span_submul_1(bn_word* r, bn_word const* a, int n, bn_word b);
+
+/*****************************************************************************
+  Batch functions
+
+  These  apply  one  operation  to  `count`  independent values. They write
+  the overflow flag at most once per call, if any of the operations
+  overflowed.
+
+  1. `bignum_add_n`, `bignum_sub_n`, `bignum_mul_n`
+    Same  as `bignum_add`, `bignum_sub` and `bignum_mul` applied to each
+    `a[i]`  and  `b[i]`,  the  result  is  stored in `out[i]`. `out` may
+    be the same array as `a`.
+
+  2. `bignum_cmp_n`
+    Stores `bignum_cmp(&a[i], &b[i])` to `out[i]`.
+
+  The  functions  below  work  on  the  structure-of-arrays layout, where word
+  `i`  of  value  `j`  is  stored at `soa[i*count + j]`, so each array takes
+  `bn_array_size*count`  words.  The  values  are processed in blocks, with
+  the carries of one block kept in an array, so that the compiler can run
+  the independent carry chains in vector registers.
+
+  3. `bignum_to_soa`, `bignum_from_soa`
+    Convert `count` Bignums to the SoA layout and back.
+
+  4. `bignum_soa_add`, `bignum_soa_sub`
+    Add  or  subtract  the  values  in  `a`  and  `b`  and store the results
+    in `r`, which may be the same as `a` or `b`.
+
+  5. `bignum_soa_mul_u32`
+    Multiplies  value  `j`  of `a` by `f[j]` and stores the result in `r`,
+    which may be the same as `a`.
+*****************************************************************************/
+bn_extern void bignum_add_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count);
+bn_extern void bignum_sub_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count);
+bn_extern void bignum_mul_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count);
+bn_extern void bignum_cmp_n(int* out, Bignum const* a, Bignum const* b, size_t count);
+
+bn_extern void bignum_to_soa(bn_word* soa, Bignum const* src, size_t count);
+bn_extern void bignum_from_soa(Bignum* dst, bn_word const* soa, size_t count);
+bn_extern void bignum_soa_add(bn_word* r, bn_word const* a, bn_word const* b, size_t count);
+bn_extern void bignum_soa_sub(bn_word* r, bn_word const* a, bn_word const* b, size_t count);
+bn_extern void bignum_soa_mul_u32(bn_word* r, bn_word const* a, uint32_t const* f, size_t count);
+
+/*****************************************************************************
+  Parallel functions
+
+  The  library  doesn't create threads, instead the caller passes a pool
+  that runs tasks for it. `run` has to call `task(arg, i)` once for every
+  `i` in `[0, count)`, on any threads, and return when all of them are done.
+  Tasks  call  `run`  again  for their own subtasks, so the pool should work
+  on  other tasks while waiting, as work-stealing schedulers do. `workers`
+  is the number of threads the pool has. Passing NULL, or a pool with a
+  single worker, runs everything on the calling thread.
+
+  Call  `bignum_init_cpu`  before using them, so that the workers don't race
+  on selecting the multiplication kernel.
+
+  With  `bn_instrument`,  the  counters  have  to  be  per  thread,  so
+  `bn_thread_local`  must  be defined if the pool runs tasks on other
+  threads. Each call is counted once, on the calling thread, and the work
+  of  its  tasks  is  accounted  to it wherever they run. Only the steps of
+  the long division, `div_steps` and `div_fixups`, go to the counters of the
+  thread that does the division.
+
+  1. `bignum_mul_parallel`
+    Same  as  `bignum_mul`. For operands of at least 2*bn_karatsuba_threshold
+      words the three half-sized products of the top levels of the Karatsuba
+      recursion  are  run  as  tasks,  as  many levels as it takes to have a
+      task for every worker.
+
+  2. `bignum_modexp_batch`
+    Runs `bignum_modexp(&res[i], &base[i], &exp[i], ctx)` for every `i` in
+      `[0, count)`, one task each. With `nctx` equal to 1 all of them use
+      `ctx[0]`, otherwise `ctx` holds `count` contexts and `ctx[i]` is used.
+*****************************************************************************/
+typedef void (*BignumTask)(void* arg, size_t index);
+
+typedef struct BignumPool BignumPool;
+struct BignumPool
+{
+  void (*run)(void* self, BignumTask task, void* arg, size_t count);
+  void* self;
+  int workers;
+};
+
+bn_extern void bignum_mul_parallel(Bignum* res, Bignum const* a, Bignum const* b, BignumPool const* pool);
+bn_extern void bignum_modexp_batch(Bignum* res, Bignum const* base, Bignum const* exp, size_t count,
+                                   BignumMont const* ctx, size_t nctx, BignumPool const* pool);
+
+/*****************************************************************************
+  CPU dispatch
+
+  With  64-bit  words  on  x86-64  the  inner loop of the multiplications,
+  which  also  runs  `bignum_sqr`,  the  Montgomery  and the Barrett
+  functions,  has  a  second  kernel built on the mulx, adcx and adox
+  instructions  of  BMI2  and ADX. It's selected on the first multiplication
+  if the CPU supports both, otherwise the portable kernel is used. If the
+  compiler already targets them (`-mbmi2 -madx` or `-march=broadwell` and
+  newer)  the  ADX  kernel  is  called directly, and `bn_no_intrinsics`
+  disables it.
+
+  1. `bignum_init_cpu`
+    Detects  the  CPU  and  selects the kernel. Calling it once before
+    starting threads avoids the detection racing on the first products.
+
+  2. `bignum_cpu_backend`
+    Returns  the  name of the selected kernel, "adx" or "generic", running
+    the detection first if it hasn't been done.
+*****************************************************************************/
+bn_extern void bignum_init_cpu(void);
+bn_extern char const* bignum_cpu_backend(void);
+
+/*****************************************************************************
+  Instrumentation
+
+  Defining  `bn_instrument`  makes  the  library count the calls of its
+  arithmetic and conversion functions, the words they work on and the steps
+  of  the  long  division,  and  call  user hooks around them. The counters
+  belong  to  the  thread  if  `bn_thread_local` is defined, otherwise they
+  are shared. Only the calls made from outside of the library are counted,
+  the  work  done  in  other functions, like the divisions of `bignum_gcd`
+  or the products of `bignum_modexp`, is accounted to the outer call.
+
+  The  counted  functions are the ones named by `BignumOp`, the `_ex` ones
+  count as the plain function and `bignum_isqrt` as `bignum_iroot`. The
+  functions  that  take  a  single pass over the words, the copies, the
+  increments,  the  bitwise  logic,  the  comparisons other than `bignum_cmp`,
+  `bignum_cmov`  and  `bignum_cswap`,  aren't  counted, and neither are
+  the  span  and  SoA  functions.  The  `_n` batch functions count as one
+  call  of  their  element function per element. Without `bn_instrument`
+  none of it is compiled in.
+
+  1. `bignum_get_counters`
+    Copies  the  counters of the calling thread to `out`. `calls[op]` is the
+      number  of  calls of `op`, `limbs[op]` the sum of the word lengths of
+      their  operands,  or  of  the  result  for  the conversions to a
+      Bignum. `div_steps` counts the quotient words computed by the long
+      division,  `div_fixups`  the  corrections of their estimates. The
+      constant-time build doesn't count corrections, it always does two.
+
+  2. `bignum_reset_counters`
+    Sets the counters of the calling thread to zero.
+
+  3. `bignum_set_hooks`
+    Sets the functions called on entry to and exit from every counted call,
+      with the operation and `user`. Either may be NULL. The hooks are shared
+      by all threads, so they should be set before starting any.
+
+  4. `bignum_op_name`
+    Returns the name of the operation, e.g. "divmod" for `bignum_op_divmod`.
+*****************************************************************************/
+#if defined(bn_instrument)
+typedef enum BignumOp
+{
+  bignum_op_from_hex,
+  bignum_op_from_dec,
+  bignum_op_from_bytes,
+  bignum_op_to_hex,
+  bignum_op_to_dec,
+  bignum_op_to_bytes,
+  bignum_op_cmp,
+  bignum_op_add,
+  bignum_op_sub,
+  bignum_op_mul,
+  bignum_op_sqr,
+  bignum_op_divmod,
+  bignum_op_add_u32,
+  bignum_op_mul_u32,
+  bignum_op_divmod_u32,
+  bignum_op_muladd,
+  bignum_op_addmul_u32,
+  bignum_op_mul_wide,
+  bignum_op_lshift,
+  bignum_op_rshift,
+  bignum_op_gcd,
+  bignum_op_lcm,
+  bignum_op_modinv,
+  bignum_op_iroot,
+  bignum_op_is_square,
+  bignum_op_miller_rabin,
+  bignum_op_is_probable_prime,
+  bignum_op_next_prime,
+  bignum_op_mont_init,
+  bignum_op_to_mont,
+  bignum_op_from_mont,
+  bignum_op_mont_mul,
+  bignum_op_mont_sqr,
+  bignum_op_modexp,
+  bignum_op_fixed_base_init,
+  bignum_op_fixed_base_exp,
+  bignum_op_barrett_init,
+  bignum_op_barrett_reduce,
+  bignum_op_barrett_mulmod,
+  bignum_op_mul_parallel,
+  bignum_op_modexp_batch,
+  bignum_op_count
+} BignumOp;
+
+typedef struct BignumCounters BignumCounters;
+struct BignumCounters
+{
+  uint64_t calls[bignum_op_count];
+  uint64_t limbs[bignum_op_count];
+  uint64_t div_steps;
+  uint64_t div_fixups;
+};
+
+typedef void (*BignumHook)(BignumOp op, void* user);
+
+bn_extern void bignum_get_counters(BignumCounters* out);
+bn_extern void bignum_reset_counters(void);
+bn_extern void bignum_set_hooks(BignumHook enter, BignumHook exit, void* user);
+bn_extern char const* bignum_op_name(BignumOp op);
+#endif
 
 /*****************************************************************************
   END OF HEADING
@@ -194,7 +905,234 @@ bn_extern void bignum_divmod(Bignum* q, Bignum *r, Bignum const* a, Bignum const
 
 #ifdef bn_implementation
 
-static int bn_overflow_flag = 0;
+// Backend for the carry chains and double-word arithmetic. The portable
+// fallback can be forced by defining `bn_no_intrinsics`.
+#if bn_word_bits == 32
+  #define bn__addcarry _addcarry_u32
+  #define bn__subborrow _subborrow_u32
+  #define bn__builtin_addc __builtin_addc
+  #define bn__builtin_subc __builtin_subc
+  typedef unsigned int bn__carry_word;
+#else
+  #define bn__addcarry _addcarry_u64
+  #define bn__subborrow _subborrow_u64
+  #define bn__builtin_addc __builtin_addcll
+  #define bn__builtin_subc __builtin_subcll
+  typedef unsigned long long bn__carry_word;
+#endif
+
+#if !defined(bn_no_intrinsics)
+  #if defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86) && bn_word_bits == 32))
+    #include <intrin.h>
+    #define bn__carry_intrin
+    #define bn__bitscan
+  #elif (defined(__GNUC__) || defined(__clang__)) && \
+        (defined(__x86_64__) || (defined(__i386__) && bn_word_bits == 32))
+    #include <x86intrin.h>
+    #define bn__carry_intrin
+  #elif defined(__has_builtin)
+    #if bn_word_bits == 32 && __has_builtin(__builtin_addc) && __has_builtin(__builtin_subc)
+      #define bn__carry_builtin_addc
+    #elif bn_word_bits == 64 && __has_builtin(__builtin_addcll) && __has_builtin(__builtin_subcll)
+      #define bn__carry_builtin_addc
+    #elif __has_builtin(__builtin_add_overflow)
+      #define bn__carry_builtin_overflow
+    #endif
+  #elif defined(__GNUC__) && __GNUC__ >= 5
+    #define bn__carry_builtin_overflow
+  #endif
+
+  // The mulx/adcx/adox kernel for `bignum__addmul_1`. It's picked at run
+  // time unless the compiler already targets BMI2 and ADX.
+  #if bn_word_bits == 64 && defined(_MSC_VER) && defined(_M_X64)
+    #define bn__adx
+  #elif bn_word_bits == 64 && (defined(__GNUC__) || defined(__clang__)) && \
+        defined(__x86_64__)
+    #include <cpuid.h>
+    #define bn__adx
+    #define bn__adx_asm
+  #endif
+  #if defined(bn__adx) && defined(__BMI2__) && defined(__ADX__)
+    #define bn__adx_static
+  #endif
+
+  // SSE2 skips equal words in `bignum__cmp_n` 32 bytes at a time.
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define bn__sse2
+  #endif
+
+  #if defined(__SIZEOF_INT128__)
+    #define bn__int128
+    __extension__ typedef unsigned __int128 bn__dword;
+  #elif defined(_MSC_VER) && defined(_M_X64)
+    #define bn__umul128
+    #if _MSC_VER >= 1920
+      #define bn__udiv128
+    #endif
+  #endif
+
+  #if defined(__GNUC__) || defined(__clang__)
+    #define bn__bswap32 __builtin_bswap32
+    #define bn__bswap64 __builtin_bswap64
+  #elif defined(_MSC_VER)
+    #include <stdlib.h>
+    #define bn__bswap32 _byteswap_ulong
+    #define bn__bswap64 _byteswap_uint64
+  #endif
+  #if defined(bn__bswap32) && bn_word_bits == 32
+    #define bn__bswap bn__bswap32
+  #elif defined(bn__bswap64)
+    #define bn__bswap bn__bswap64
+  #endif
+#endif
+
+// The byte conversions copy the array directly on little-endian hosts.
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64) || \
+                           defined(_M_ARM) || defined(_M_ARM64)))
+  #define bn__little_endian
+#endif
+
+static bn_thread_local int bn_overflow_flag = 0;
+
+// Instrumentation. `bn__enter` and `bn__exit` bracket the counted functions,
+// `bn__depth` tells the calls from outside of the library from the nested
+// ones. The limb count isn't evaluated unless bn_instrument is defined.
+// `bn__enter_task` and `bn__exit_task` bracket the tasks run by a pool, they
+// raise the depth of the worker without counting, as the call was already
+// counted on the thread that started it.
+#if defined(bn_instrument)
+static bn_thread_local BignumCounters bn__counters;
+static bn_thread_local int bn__depth = 0;
+static BignumHook bn__hook_enter = 0;
+static BignumHook bn__hook_exit = 0;
+static void *bn__hook_user = 0;
+
+// The limb counts use the words up to the top non-zero one.
+static int bignum__get_ndigits(Bignum const *b);
+
+static char const *const bn__op_names[bignum_op_count] = {
+  "from_hex", "from_dec", "from_bytes", "to_hex", "to_dec", "to_bytes",
+  "cmp", "add", "sub", "mul", "sqr", "divmod", "add_u32", "mul_u32",
+  "divmod_u32", "muladd", "addmul_u32", "mul_wide", "lshift", "rshift",
+  "gcd", "lcm", "modinv", "iroot", "is_square", "miller_rabin",
+  "is_probable_prime", "next_prime", "mont_init", "to_mont", "from_mont",
+  "mont_mul", "mont_sqr", "modexp", "fixed_base_init",
+  "fixed_base_exp", "barrett_init", "barrett_reduce", "barrett_mulmod",
+  "mul_parallel", "modexp_batch",
+};
+
+static void
+bignum__instrument_enter(BignumOp op, uint64_t limbs)
+{
+  if(bn__depth++ == 0) {
+    bn__counters.calls[op] += 1;
+    bn__counters.limbs[op] += limbs;
+    if(bn__hook_enter) bn__hook_enter(op, bn__hook_user);
+  }
+}
+
+static void
+bignum__instrument_exit(BignumOp op)
+{
+  if(--bn__depth == 0 && bn__hook_exit) {
+    bn__hook_exit(op, bn__hook_user);
+  }
+}
+
+void bignum_get_counters(BignumCounters* out)
+{
+  bn_assert(out);
+  *out = bn__counters;
+}
+
+void bignum_reset_counters(void)
+{
+  BignumCounters zero = {{0}, {0}, 0, 0};
+  bn__counters = zero;
+}
+
+void bignum_set_hooks(BignumHook enter, BignumHook exit, void* user)
+{
+  bn__hook_enter = enter;
+  bn__hook_exit = exit;
+  bn__hook_user = user;
+}
+
+char const* bignum_op_name(BignumOp op)
+{
+  bn_assert(0 <= (int)op && op < bignum_op_count);
+  return bn__op_names[op];
+}
+
+  #define bn__enter(op, limbs) bignum__instrument_enter((op), (uint64_t)(limbs))
+  #define bn__exit(op) bignum__instrument_exit(op)
+  #define bn__count(counter, n) (bn__counters.counter += (uint64_t)(n))
+  #define bn__enter_task() ((void)++bn__depth)
+  #define bn__exit_task() ((void)--bn__depth)
+#else
+  #define bn__enter(op, limbs) ((void)0)
+  #define bn__exit(op) ((void)0)
+  #define bn__count(counter, n) ((void)0)
+  #define bn__enter_task() ((void)0)
+  #define bn__exit_task() ((void)0)
+#endif
+
+// Number of hex digits in a word.
+#define bn__word_digits (bn_word_bits/4)
+
+// Number of low words of `n` that may be non-zero. With bn_track_length it
+// is the cached length, otherwise the whole array.
+static inline int
+bignum__used(Bignum const *n)
+{
+#if defined(bn_track_length)
+  bn_assert(0 <= n->length && n->length <= bn_array_size);
+  return n->length;
+#else
+  (void)n;
+  return bn_array_size;
+#endif
+}
+
+// Recomputes the cached length of `n`, given that all words from `top` up
+// are zero.
+static inline void
+bignum__set_length(Bignum *n, int top)
+{
+#if defined(bn_track_length)
+  while(top != 0 && n->array[top-1] == 0) {
+    top --;
+  }
+  n->length = top;
+#else
+  (void)n;
+  (void)top;
+#endif
+}
+
+// Finishes a result of which words [0..used) were just written: zeroes the
+// words that were in use before and updates the cached length.
+static inline void
+bignum__finish(Bignum *n, int used)
+{
+  int old = bignum__used(n);
+  for(int i = used; i < old; ++i) {
+    n->array[i] = 0;
+  }
+  bignum__set_length(n, used);
+}
+
+// Stores `words[0..count)` as the value of `n`.
+static void
+bignum__store(Bignum *n, bn_word const *words, int count)
+{
+  for(int i = 0; i != count; ++i) {
+    n->array[i] = words[i];
+  }
+  bignum__finish(n, count);
+}
 
 void bignum_init(Bignum* n)
 {
@@ -205,6 +1143,7 @@ void bignum_init(Bignum* n)
   {
     n->array[i] = 0;
   }
+  bignum__set_length(n, 0);
 }
 
 void bignum_from_u64(Bignum* bn, uint64_t n)
@@ -212,17 +1151,71 @@ void bignum_from_u64(Bignum* bn, uint64_t n)
   bn_assert(bn);
   bignum_init(bn);
 
-  bn->array[0] = (uint32_t)n;
-  bn->array[1] = (uint32_t)(n >> 32);
-  for(int i = 2; i < bn_array_size; ++i) {
-    bn->array[i] = 0;
-  }
+  bn->array[0] = (bn_word)n;
+#if bn_word_bits == 32
+  bn->array[1] = (bn_word)(n >> 32);
+#endif
+  bignum__set_length(bn, 64/bn_word_bits);
 }
 
+// Branch-free value of a hex digit of either case: letters have bit 6 set,
+// and their low four bits are one less than the value past 9.
 static inline int hexchar__to_int(char a)
 {
-  if('a' <= a && a <= 'f') return a-'a'+10;
-  else return a-'0';
+  return (a & 0xF) + 9*((a >> 6) & 1);
+}
+
+static inline int hexchar__is_valid(char a)
+{
+  return ('0' <= a && a <= '9') || ('a' <= a && a <= 'f')
+      || ('A' <= a && a <= 'F');
+}
+
+// Checks `str[0..len)` for non-hex characters. Only used in assertions, so
+// it's skipped when bn_assert is disabled.
+static inline int
+bignum__hex_is_valid(char const *str, int len)
+{
+  for(int i = 0; i != len; ++i) {
+    if(!hexchar__is_valid(str[i])) return 0;
+  }
+  return 1;
+}
+
+// Loads 8 characters into a 64-bit value, the first one in the low byte.
+static inline uint64_t
+bignum__load8(char const *s)
+{
+  uint64_t x = 0;
+  for(int i = 8; i-- != 0;) {
+    x = (x << 8) | (unsigned char)s[i];
+  }
+  return x;
+}
+
+// Decodes 8 hex digits at once, with hexchar__to_int done on all bytes in
+// parallel and the nibbles gathered in three steps.
+static inline uint32_t
+bignum__hex8_decode(char const *s)
+{
+  uint64_t x = bignum__load8(s);
+  x = (x & UINT64_C(0x0F0F0F0F0F0F0F0F))
+    + ((x >> 6) & UINT64_C(0x0101010101010101))*9;
+  x = ((x << 4) | (x >> 8)) & UINT64_C(0x00FF00FF00FF00FF);
+  x = ((x << 8) | (x >> 16)) & UINT64_C(0x0000FFFF0000FFFF);
+  x = ((x << 16) | (x >> 32)) & UINT64_C(0x00000000FFFFFFFF);
+  return (uint32_t)x;
+}
+
+// Decodes the bn__word_digits hex digits of a word.
+static inline bn_word
+bignum__hex_decode_word(char const *s)
+{
+#if bn_word_bits == 32
+  return bignum__hex8_decode(s);
+#else
+  return ((bn_word)bignum__hex8_decode(s) << 32) | bignum__hex8_decode(s+8);
+#endif
 }
 
 void bignum_from_hex(Bignum* n, char const* str, int maxsize)
@@ -238,56 +1231,123 @@ void bignum_from_hex(Bignum* n, char const* str, int maxsize)
   for(int i = 0; i != maxsize; ++i) {
     if(str[i] == 0) {
       strsize = i;
-      maxsize = i;
       break;
     }
   }
+  bn_assert(bignum__hex_is_valid(str, strsize));
+  bn__enter(bignum_op_from_hex, (strsize + bn__word_digits-1)/bn__word_digits);
+
+  // The words are filled from the end of the string, which holds the
+  // lowest digits. Only the topmost word may be partial.
+  int i = strsize;
+  int wc = 0;
+  while(i >= bn__word_digits && wc != bn_array_size) {
+    i -= bn__word_digits;
+    n->array[wc++] = bignum__hex_decode_word(str + i);
+  }
+  if(i != 0 && wc != bn_array_size) {
+    bn_word word = 0;
+    for(int k = 0; k != i; ++k) {
+      word = 16*word + (bn_word)hexchar__to_int(str[k]);
+    }
+    n->array[wc++] = word;
+    i = 0;
+  }
 
-  if(8*bn_array_size >= strsize) {
-    // We write the maximum number of digits that's in a string
-    // and here overflow is impossible since the string is
-    // shorter.
-    uint32_t word = 0;
-    int dc = 0;
-    int wc = 0;
-    int i = 0;
-    do {
-      word = 16*word + hexchar__to_int(str[i++]);
-      if(++dc == 8) {
-        n->array[wc++] = word;
-        dc = 0;
-        word = 0;
-      }
-    } while(i < strsize);
-    if(dc != 0) {
-      n->array[wc] = word;
+  // Whatever is left didn't fit, it overflows unless it's all zeros.
+  for(int k = 0; k != i; ++k) {
+    if(str[k] != '0') {
+      bn_overflow_flag = 1;
+      break;
+    }
+  }
+  bignum__set_length(n, wc);
+  bn__exit(bignum_op_from_hex);
+}
+
+// Loads a word stored with its most significant byte first.
+static inline bn_word
+bignum__load_be(uint8_t const *p)
+{
+#if defined(bn__little_endian) && defined(bn__bswap)
+  bn_word w;
+  unsigned char *d = (unsigned char *)&w;
+  for(size_t i = 0; i != sizeof(w); ++i) {
+    d[i] = p[i];
+  }
+  return bn__bswap(w);
+#else
+  bn_word w = 0;
+  for(size_t i = 0; i != sizeof(w); ++i) {
+    w = (w << 8) | p[i];
+  }
+  return w;
+#endif
+}
+
+// Stores a word with its most significant byte first.
+static inline void
+bignum__store_be(uint8_t *p, bn_word w)
+{
+#if defined(bn__little_endian) && defined(bn__bswap)
+  w = bn__bswap(w);
+  unsigned char const *s = (unsigned char const *)&w;
+  for(size_t i = 0; i != sizeof(w); ++i) {
+    p[i] = s[i];
+  }
+#else
+  for(size_t i = sizeof(w); i-- != 0;) {
+    p[i] = (uint8_t)w;
+    w >>= 8;
+  }
+#endif
+}
+
+void bignum_from_bytes(Bignum* n, uint8_t const* bytes, size_t size, int big_endian)
+{
+  bn_assert(n);
+  bn_assert(bytes || size == 0);
+  bignum_init(n);
+
+  size_t const wb = sizeof(bn_word);
+  size_t nbytes = (size < sizeof(n->array))? size : sizeof(n->array);
+  bn__enter(bignum_op_from_bytes, (int)((nbytes + wb-1)/wb));
+
+  // Bytes past the array only overflow if they are non-zero. `i` counts
+  // bytes from the least significant one.
+  size_t extra = size - nbytes;
+  uint8_t const *top = big_endian? bytes : bytes + nbytes;
+  for(size_t i = 0; i != extra; ++i) {
+    if(top[i] != 0) {
+      bn_overflow_flag = 1;
+      break;
+    }
+  }
+
+  if(!big_endian) {
+#if defined(bn__little_endian)
+    unsigned char *d = (unsigned char *)n->array;
+    for(size_t i = 0; i != nbytes; ++i) {
+      d[i] = bytes[i];
     }
+#else
+    for(size_t i = 0; i != nbytes; ++i) {
+      n->array[i/wb] |= (bn_word)bytes[i] << 8*(i%wb);
+    }
+#endif
   }
   else {
-    // We only write 8*bn_array_size digits into the number
-    // and if at least one of first digits of big endian
-    // string is non zero we set overflow flag.
-    int wc = bn_array_size;
-    int nfirstdigits = strsize - 8*bn_array_size;
-    for(int i = nfirstdigits; i != strsize;) {
-      uint32_t word = 0;
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      word = 16*word + hexchar__to_int(str[i++]);
-      n->array[--wc] = word;
-    }
-    for(int i = 0; i != nfirstdigits; ++i) {
-      if(str[i] != 0) {
-        bn_overflow_flag = 1;
-        break;
-      }
+    uint8_t const *end = bytes + size;
+    size_t full = nbytes/wb;
+    for(size_t k = 0; k != full; ++k) {
+      n->array[k] = bignum__load_be(end - (k+1)*wb);
+    }
+    for(size_t i = full*wb; i != nbytes; ++i) {
+      n->array[i/wb] |= (bn_word)end[-1-(ptrdiff_t)i] << 8*(i%wb);
     }
   }
+  bignum__set_length(n, (int)((nbytes + wb-1)/wb));
+  bn__exit(bignum_op_from_bytes);
 }
 
 void bignum_assign(Bignum* dst, Bignum const* src)
@@ -295,11 +1355,18 @@ void bignum_assign(Bignum* dst, Bignum const* src)
   bn_assert(dst);
   bn_assert(src);
 
+  // `dst` may be uninitialized, so nothing is read from it.
+  int used = bignum__used(src);
   int i;
-  for (i = 0; i < bn_array_size; ++i)
+  for (i = 0; i < used; ++i)
   {
     dst->array[i] = src->array[i];
   }
+  for (; i < bn_array_size; ++i)
+  {
+    dst->array[i] = 0;
+  }
+  bignum__set_length(dst, used);
 }
 
 
@@ -307,29 +1374,52 @@ void bignum_assign(Bignum* dst, Bignum const* src)
 uint64_t u64_from_bignum(Bignum const* n)
 {
   bn_assert(n);
+#if bn_word_bits == 32
   uint64_t low = (uint64_t)n->array[0];
   uint64_t high = (uint64_t)n->array[1];
   uint64_t result = low | (high<<32);
-  for(int i = 2; i < bn_array_size; ++i) if(n->array[i] != 0) {
+#else
+  uint64_t result = n->array[0];
+#endif
+  for(int i = 64/bn_word_bits; i < bignum__used(n); ++i) if(n->array[i] != 0) {
     bn_overflow_flag = 1;
   }
   return result;
 }
 
-static inline char bn__hexlo(uint32_t b)
+static char const bn__hex_digits[16] = {
+  '0', '1', '2', '3', '4', '5', '6', '7',
+  '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+};
+
+// Encodes a 32-bit value as 8 hex digits at once. The nibbles are spread to
+// one per byte, highest first, and turned into characters in parallel.
+static inline void
+bignum__hex8_encode(char *s, uint32_t w)
 {
-  char q=(char)(b&0x0F);
-  if(q>=10) q+=-10+'a';
-  else q+='0';
-  return q;
+  uint64_t x = (w >> 16) | ((uint64_t)(w & 0xFFFF) << 32);
+  x = ((x >> 8) & UINT64_C(0x000000FF000000FF))
+    | ((x & UINT64_C(0x000000FF000000FF)) << 16);
+  x = ((x >> 4) & UINT64_C(0x000F000F000F000F))
+    | ((x & UINT64_C(0x000F000F000F000F)) << 8);
+  // '0' + n, plus 'a' - '0' - 10 for the bytes that are at least 10.
+  x += UINT64_C(0x3030303030303030)
+     + (((x + UINT64_C(0x0606060606060606)) >> 4) & UINT64_C(0x0101010101010101))*0x27;
+  for(int i = 0; i != 8; ++i) {
+    s[i] = (char)(x >> 8*i);
+  }
 }
 
-static inline char bn__hexhi(uint32_t b)
+// Encodes the bn__word_digits hex digits of a word.
+static inline void
+bignum__hex_encode_word(char *s, bn_word w)
 {
-  char q=(char)(b>>4);
-  if(q>=10)q+='a';
-  else q+='0';
-  return q;
+#if bn_word_bits == 32
+  bignum__hex8_encode(s, w);
+#else
+  bignum__hex8_encode(s, (uint32_t)(w >> 32));
+  bignum__hex8_encode(s+8, (uint32_t)w);
+#endif
 }
 
 void hex_from_bignum(Bignum const* n, char* str, int maxsize)
@@ -338,372 +1428,3903 @@ void hex_from_bignum(Bignum const* n, char* str, int maxsize)
   bn_assert(str);
   bn_assert(maxsize > 0);
 
-  int num_digits = maxsize - 1;
-  int words_remain = 1+(num_digits-1)/8;
-  int d = num_digits;
+  // Full words are written from the end of the string, the rest is either
+  // the low digits of one more word, or zero padding past the top.
+  int d = maxsize - 1;
   int wi = 0;
-
-  while(words_remain-- > 0) {
-    uint32_t word = n->array[wi++];
-    int digits = 8;
-    while(digits-- != 0) {
-      str[--d] = bn__hexlo(word);
-      word /= 16;
+  int used = bignum__used(n);
+  bn__enter(bignum_op_to_hex, bignum__get_ndigits(n));
+  while(d >= bn__word_digits && wi != used) {
+    d -= bn__word_digits;
+    bignum__hex_encode_word(str + d, n->array[wi++]);
+  }
+  if(d != 0 && wi != used) {
+    bn_word word = n->array[wi];
+    int digits = (d < bn__word_digits)? d : bn__word_digits;
+    for(int k = 0; k != digits; ++k) {
+      str[--d] = bn__hex_digits[word & 15];
+      word >>= 4;
     }
   }
-
-  uint32_t first_word = n->array[wi++];
-  int digits_per_last_word = 1+(num_digits-1)%8;
-  while(digits_per_last_word-- != 0) {
-    str[--d] = bn__hexlo(first_word);
-    first_word /= 16;  
+  while(d != 0) {
+    str[--d] = '0';
   }
 
   str[maxsize-1] = 0;
+  bn__exit(bignum_op_to_hex);
 }
 
-
-
-void bignum_reset_overflow_flag(void)
-{
-  bn_overflow_flag = 0;
-}
-
-int bignum_is_overflow(void)
+void bytes_from_bignum(Bignum const* n, uint8_t* bytes, size_t size, int big_endian)
 {
-  return bn_overflow_flag;
-}
+  bn_assert(n);
+  bn_assert(bytes || size == 0);
 
+  size_t const wb = sizeof(bn_word);
+  size_t nbytes = (size < sizeof(n->array))? size : sizeof(n->array);
+  bn__enter(bignum_op_to_bytes, (int)((nbytes + wb-1)/wb));
 
+  // The value is cut to `size` bytes, which is an overflow unless the cut
+  // bytes are zero.
+  for(size_t i = nbytes; i < (size_t)bignum__used(n)*wb; ++i) {
+    if(((n->array[i/wb] >> 8*(i%wb)) & 0xFF) != 0) {
+      bn_overflow_flag = 1;
+      break;
+    }
+  }
 
-void bignum_incr(Bignum* n)
+  if(!big_endian) {
+#if defined(bn__little_endian)
+    unsigned char const *s = (unsigned char const *)n->array;
+    for(size_t i = 0; i != nbytes; ++i) {
+      bytes[i] = s[i];
+    }
+#else
+    for(size_t i = 0; i != nbytes; ++i) {
+      bytes[i] = (uint8_t)(n->array[i/wb] >> 8*(i%wb));
+    }
+#endif
+    for(size_t i = nbytes; i != size; ++i) {
+      bytes[i] = 0;
+    }
+  }
+  else {
+    uint8_t *end = bytes + size;
+    size_t full = nbytes/wb;
+    for(size_t k = 0; k != full; ++k) {
+      bignum__store_be(end - (k+1)*wb, n->array[k]);
+    }
+    for(size_t i = full*wb; i != nbytes; ++i) {
+      end[-1-(ptrdiff_t)i] = (uint8_t)(n->array[i/wb] >> 8*(i%wb));
+    }
+    for(size_t i = 0; i != size - nbytes; ++i) {
+      bytes[i] = 0;
+    }
+  }
+  bn__exit(bignum_op_to_bytes);
+}
+
+
+
+void bignum_reset_overflow_flag(void)
+{
+  bn_overflow_flag = 0;
+}
+
+int bignum_is_overflow(void)
+{
+  return bn_overflow_flag;
+}
+
+
+
+static int
+bignum__get_ndigits(Bignum const *b)
+{
+#if defined(bn_track_length)
+  return (b->length != 0)? b->length : 1;
+#else
+  int ndigits = bn_array_size;
+  do {
+    if(b->array[ndigits-1] != 0) {
+      break;
+    }
+    ndigits --;
+  } while(ndigits != 1);
+  return ndigits;
+#endif
+}
+
+// Number of words an operation has to go over for a value that may be
+// secret. In constant-time mode the length isn't looked at.
+static inline int
+bignum__secret_ndigits(Bignum const *b)
+{
+#if defined(bn_constant_time)
+  (void)b;
+  return bn_array_size;
+#else
+  return bignum__get_ndigits(b);
+#endif
+}
+
+static inline int
+bignum__clz(bn_word w)
+{
+  bn_assert(w != 0);
+#if (defined(__GNUC__) || defined(__clang__)) && bn_word_bits == 32
+  return __builtin_clz(w);
+#elif (defined(__GNUC__) || defined(__clang__)) && bn_word_bits == 64
+  return __builtin_clzll(w);
+#elif defined(bn__bitscan)
+  unsigned long index;
+#if bn_word_bits == 32
+  _BitScanReverse(&index, w);
+#else
+  _BitScanReverse64(&index, w);
+#endif
+  return bn_word_bits-1 - (int)index;
+#else
+  int n = 0;
+#if bn_word_bits == 64
+  if((w >> 32) == 0) { n += 32; w <<= 32; }
+#endif
+  if((w >> (bn_word_bits-16)) == 0) { n += 16; w <<= 16; }
+  if((w >> (bn_word_bits- 8)) == 0) { n +=  8; w <<=  8; }
+  if((w >> (bn_word_bits- 4)) == 0) { n +=  4; w <<=  4; }
+  if((w >> (bn_word_bits- 2)) == 0) { n +=  2; w <<=  2; }
+  if((w >> (bn_word_bits- 1)) == 0) { n +=  1; }
+  return n;
+#endif
+}
+
+static inline int
+bignum__ctz(bn_word w)
+{
+  bn_assert(w != 0);
+#if (defined(__GNUC__) || defined(__clang__)) && bn_word_bits == 32
+  return __builtin_ctz(w);
+#elif (defined(__GNUC__) || defined(__clang__)) && bn_word_bits == 64
+  return __builtin_ctzll(w);
+#elif defined(bn__bitscan)
+  unsigned long index;
+#if bn_word_bits == 32
+  _BitScanForward(&index, w);
+#else
+  _BitScanForward64(&index, w);
+#endif
+  return (int)index;
+#else
+  int n = 0;
+#if bn_word_bits == 64
+  if((w & 0xFFFFFFFF) == 0) { n += 32; w >>= 32; }
+#endif
+  if((w & 0xFFFF) == 0) { n += 16; w >>= 16; }
+  if((w & 0x00FF) == 0) { n +=  8; w >>=  8; }
+  if((w & 0x000F) == 0) { n +=  4; w >>=  4; }
+  if((w & 0x0003) == 0) { n +=  2; w >>=  2; }
+  if((w & 0x0001) == 0) { n +=  1; }
+  return n;
+#endif
+}
+
+// Stores a + b + carry to `sum` and returns the carry out. `carry` must be
+// 0 or 1.
+static inline bn_word
+bignum__addc(bn_word a, bn_word b, bn_word carry, bn_word *sum)
+{
+#if defined(bn__carry_intrin)
+  bn__carry_word s;
+  unsigned char c = bn__addcarry((unsigned char)carry, a, b, &s);
+  *sum = (bn_word)s;
+  return c;
+#elif defined(bn__carry_builtin_addc)
+  bn__carry_word c;
+  *sum = (bn_word)bn__builtin_addc(a, b, carry, &c);
+  return (bn_word)c;
+#elif defined(bn__carry_builtin_overflow)
+  bn_word s;
+  bn_word c1 = __builtin_add_overflow(a, b, &s);
+  bn_word c2 = __builtin_add_overflow(s, carry, sum);
+  return c1 | c2;
+#elif bn_word_bits == 32
+  uint64_t tmp = (uint64_t)a + b + carry;
+  *sum = (bn_word)tmp;
+  return (bn_word)(tmp >> 32);
+#else
+  bn_word s = a + b;
+  bn_word c = (s < a);
+  s += carry;
+  *sum = s;
+  return c | (s < carry);
+#endif
+}
+
+// Stores a - b - borrow to `diff` and returns the borrow out. `borrow` must
+// be 0 or 1.
+static inline bn_word
+bignum__subb(bn_word a, bn_word b, bn_word borrow, bn_word *diff)
+{
+#if defined(bn__carry_intrin)
+  bn__carry_word d;
+  unsigned char c = bn__subborrow((unsigned char)borrow, a, b, &d);
+  *diff = (bn_word)d;
+  return c;
+#elif defined(bn__carry_builtin_addc)
+  bn__carry_word c;
+  *diff = (bn_word)bn__builtin_subc(a, b, borrow, &c);
+  return (bn_word)c;
+#elif defined(bn__carry_builtin_overflow)
+  bn_word d;
+  bn_word c1 = __builtin_sub_overflow(a, b, &d);
+  bn_word c2 = __builtin_sub_overflow(d, borrow, diff);
+  return c1 | c2;
+#else
+  bn_word d = a - b - borrow;
+  *diff = d;
+  return (a < b) | ((a == b) & borrow);
+#endif
+}
+
+// Turns 0 or 1 into a word of all zero or all one bits. The empty asm
+// statement hides the value from the optimizer, so that the selects done
+// with the mask aren't turned back into branches.
+static inline bn_word
+bignum__mask(bn_word bit)
+{
+  bn_word mask = (bn_word)0 - bit;
+#if !defined(bn_no_intrinsics) && (defined(__GNUC__) || defined(__clang__))
+  __asm__("" : "+r"(mask));
+#endif
+  return mask;
+}
+
+// Returns 1 if `w` is non-zero and 0 otherwise, without a branch.
+static inline bn_word
+bignum__nonzero(bn_word w)
+{
+  return (w | ((bn_word)0 - w)) >> (bn_word_bits-1);
+}
+
+// Stores `a[0..n)` to `r[0..n)` where `mask` is all ones, keeps `r`
+// where it's zero.
+static inline void
+bignum__cselect_n(bn_word *r, bn_word const *a, int n, bn_word mask)
+{
+  for(int i = 0; i != n; ++i) {
+    r[i] ^= (r[i] ^ a[i]) & mask;
+  }
+}
+
+// Swaps `a[0..n)` and `b[0..n)` if `mask` is all ones.
+static inline void
+bignum__cswap_n(bn_word *a, bn_word *b, int n, bn_word mask)
+{
+  for(int i = 0; i != n; ++i) {
+    bn_word t = (a[i] ^ b[i]) & mask;
+    a[i] ^= t;
+    b[i] ^= t;
+  }
+}
+
+// Returns 1 if `a[0..n)` is less than `b[0..n)`, which is the borrow out of
+// their difference.
+static inline bn_word
+bignum__less_n(bn_word const *a, bn_word const *b, int n)
+{
+  bn_word borrow = 0;
+  for(int i = 0; i != n; ++i) {
+    bn_word d;
+    borrow = bignum__subb(a[i], b[i], borrow, &d);
+  }
+  return borrow;
+}
+
+// Returns the low word of a*b, the high word is stored to `hi`.
+static inline bn_word
+bignum__mulw(bn_word a, bn_word b, bn_word *hi)
+{
+#if bn_word_bits == 32
+  uint64_t p = (uint64_t)a * b;
+  *hi = (bn_word)(p >> 32);
+  return (bn_word)p;
+#elif defined(bn__int128)
+  bn__dword p = (bn__dword)a * b;
+  *hi = (bn_word)(p >> 64);
+  return (bn_word)p;
+#elif defined(bn__umul128)
+  unsigned __int64 h;
+  bn_word lo = _umul128(a, b, &h);
+  *hi = h;
+  return lo;
+#else
+  // Schoolbook multiplication of the 32-bit halves.
+  uint64_t al = (uint32_t)a, ah = a >> 32;
+  uint64_t bl = (uint32_t)b, bh = b >> 32;
+  uint64_t ll = al*bl;
+  uint64_t lh = al*bh;
+  uint64_t hl = ah*bl;
+  uint64_t hh = ah*bh;
+  uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+  *hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  return (mid << 32) | (uint32_t)ll;
+#endif
+}
+
+// Divides the double word hi:lo by `d`, where hi < d. Returns the quotient,
+// the remainder is stored to `rem`.
+static inline bn_word
+bignum__divw(bn_word hi, bn_word lo, bn_word d, bn_word *rem)
+{
+  bn_assert(hi < d);
+#if defined(bn_constant_time)
+  // Restoring division, one quotient bit per step. The remainder stays
+  // below d, so every step subtracts d at most once, and the subtraction is
+  // always computed and selected with a mask.
+  bn_word r = hi;
+  bn_word q = 0;
+  for(int i = bn_word_bits; i-- != 0; ) {
+    bn_word top = r >> (bn_word_bits-1);
+    r = (r << 1) | ((lo >> i) & 1);
+    bn_word diff;
+    bn_word take = top | (bignum__subb(r, d, 0, &diff) ^ 1);
+    r ^= (r ^ diff) & bignum__mask(take);
+    q = (q << 1) | take;
+  }
+  *rem = r;
+  return q;
+#elif bn_word_bits == 32
+  uint64_t num = ((uint64_t)hi << 32) | lo;
+  *rem = (bn_word)(num % d);
+  return (bn_word)(num / d);
+#elif defined(bn__int128)
+  bn__dword num = ((bn__dword)hi << 64) | lo;
+  *rem = (bn_word)(num % d);
+  return (bn_word)(num / d);
+#elif defined(bn__udiv128)
+  unsigned __int64 r;
+  bn_word q = _udiv128(hi, lo, d, &r);
+  *rem = r;
+  return q;
+#else
+  // Division of 32-bit halves, as in Algorithm D with a two-word divisor
+  // (Hacker's Delight, divlu).
+  uint64_t const b = UINT64_C(1) << 32;
+  int s = bignum__clz(d);
+  d <<= s;
+  uint64_t vn1 = d >> 32;
+  uint64_t vn0 = (uint32_t)d;
+  uint64_t un32 = (hi << s) | ((s != 0)? lo >> (64-s) : 0);
+  uint64_t un10 = lo << s;
+  uint64_t un1 = un10 >> 32;
+  uint64_t un0 = (uint32_t)un10;
+
+  uint64_t q1 = un32 / vn1;
+  uint64_t rhat = un32 - q1*vn1;
+  while(q1 >= b || q1*vn0 > b*rhat + un1) {
+    q1 -= 1;
+    rhat += vn1;
+    if(rhat >= b) break;
+  }
+  uint64_t un21 = un32*b + un1 - q1*d;
+
+  uint64_t q0 = un21 / vn1;
+  rhat = un21 - q0*vn1;
+  while(q0 >= b || q0*vn0 > b*rhat + un0) {
+    q0 -= 1;
+    rhat += vn1;
+    if(rhat >= b) break;
+  }
+  *rem = (un21*b + un0 - q0*d) >> s;
+  return q1*b + q0;
+#endif
+}
+
+#if defined(bn_constant_time)
+// Divides hi:lo by `d`, which has the top bit set, using the reciprocal
+// v = floor((B**2-1)/d) - B, as in Moller and Granlund, "Improved division
+// by invariant integers". Needs hi < d. Both corrections are done with
+// masks, so the division only takes a multiplication and a few word
+// operations, unlike the bitwise `bignum__divw`.
+static inline bn_word
+bignum__divw_preinv(bn_word hi, bn_word lo, bn_word d, bn_word v,
+                    bn_word *rem)
+{
+  bn_word q1;
+  bn_word q0 = bignum__mulw(v, hi, &q1);
+  q1 += hi + 1 + bignum__addc(q0, lo, 0, &q0);
+  bn_word r = lo - q1*d;
+
+  // The estimate is at most one too large or one too small.
+  bn_word t;
+  bn_word mask = bignum__mask(bignum__subb(q0, r, 0, &t));
+  q1 += mask;
+  r += d & mask;
+  bn_word ge = bignum__subb(r, d, 0, &t) ^ 1;
+  q1 += ge;
+  r ^= (r ^ t) & bignum__mask(ge);
+
+  *rem = r;
+  return q1;
+}
+#endif
+
+// Adds `b*a[0..n)` to `r[0..n)` and returns the word that has to be carried
+// into `r[n]`.
+static bn_word
+bignum__addmul_1_generic(bn_word *r, bn_word const *a, int n, bn_word b)
+{
+  bn_word carry = 0;
+  for(int i = 0; i != n; ++i) {
+    // The high word of the product is at most B-2, so it can't overflow
+    // from the two carries.
+    bn_word hi;
+    bn_word lo = bignum__mulw(a[i], b, &hi);
+    hi += bignum__addc(lo, carry, 0, &lo);
+    hi += bignum__addc(lo, r[i], 0, &r[i]);
+    carry = hi;
+  }
+  return carry;
+}
+
+#if defined(bn__adx)
+// Same as `bignum__addmul_1_generic`, for CPUs with BMI2 and ADX. The low
+// halves  of  the  products  take  the  high halves of the previous ones
+// through the CF chain of adcx, and are added to r through the OF chain of
+// adox, so the two chains don't wait for each other. The loop counter
+// moves with lea and jrcxz, which leave the flags alone.
+static bn_word
+bignum__addmul_1_adx(bn_word *r, bn_word const *a, int n, bn_word b)
+{
+#if defined(bn__adx_asm)
+  int head = n & 3;
+  bn_word carry = bignum__addmul_1_generic(r, a, head, b);
+  if(head == n) {
+    return carry;
+  }
+  r += head;
+  a += head;
+  long blocks = -(long)(n >> 2);
+  bn_word t0, t1;
+  __asm__(
+    "xor %k[t0], %k[t0]\n\t"
+    "1:\n\t"
+    "mulx (%[a]), %[t0], %[t1]\n\t"
+    "adcx %[c], %[t0]\n\t"
+    "adox (%[r]), %[t0]\n\t"
+    "mov %[t0], (%[r])\n\t"
+    "mulx 8(%[a]), %[t0], %[c]\n\t"
+    "adcx %[t1], %[t0]\n\t"
+    "adox 8(%[r]), %[t0]\n\t"
+    "mov %[t0], 8(%[r])\n\t"
+    "mulx 16(%[a]), %[t0], %[t1]\n\t"
+    "adcx %[c], %[t0]\n\t"
+    "adox 16(%[r]), %[t0]\n\t"
+    "mov %[t0], 16(%[r])\n\t"
+    "mulx 24(%[a]), %[t0], %[c]\n\t"
+    "adcx %[t1], %[t0]\n\t"
+    "adox 24(%[r]), %[t0]\n\t"
+    "mov %[t0], 24(%[r])\n\t"
+    "lea 32(%[a]), %[a]\n\t"
+    "lea 32(%[r]), %[r]\n\t"
+    "lea 1(%[n]), %[n]\n\t"
+    "jrcxz 2f\n\t"
+    "jmp 1b\n"
+    "2:\n\t"
+    "mov $0, %k[t0]\n\t"
+    "adcx %[t0], %[c]\n\t"
+    "adox %[t0], %[c]"
+    : [r] "+&r" (r), [a] "+&r" (a), [n] "+&c" (blocks), [c] "+&r" (carry),
+      [t0] "=&r" (t0), [t1] "=&r" (t1)
+    : "d" (b)
+    : "cc", "memory");
+  return carry;
+#else
+  unsigned char cf = 0;
+  unsigned char of = 0;
+  unsigned __int64 carry = 0;
+  for(int i = 0; i != n; ++i) {
+    unsigned __int64 hi;
+    unsigned __int64 lo = _mulx_u64(a[i], b, &hi);
+    cf = _addcarryx_u64(cf, lo, carry, &lo);
+    of = _addcarryx_u64(of, lo, r[i], &r[i]);
+    carry = hi;
+  }
+  return carry + cf + of;
+#endif
+}
+#endif
+
+#if defined(bn__adx) && !defined(bn__adx_static)
+typedef bn_word bn__addmul_1_fn(bn_word *r, bn_word const *a, int n, bn_word b);
+
+static bn__addmul_1_fn bignum__addmul_1_first;
+static bn__addmul_1_fn *volatile bn__addmul_1_impl = bignum__addmul_1_first;
+
+// The first call detects the CPU and replaces the pointer, after that it
+// goes straight to the kernel. Every thread stores the same value.
+static bn_word
+bignum__addmul_1_first(bn_word *r, bn_word const *a, int n, bn_word b)
+{
+  bignum_init_cpu();
+  return bn__addmul_1_impl(r, a, n, b);
+}
+#endif
+
+// Adds `b*a[0..n)` to `r[0..n)` and returns the word that has to be carried
+// into `r[n]`. This is the inner loop of all products, so it goes to the
+// fastest kernel the CPU supports.
+static inline bn_word
+bignum__addmul_1(bn_word *r, bn_word const *a, int n, bn_word b)
+{
+#if defined(bn__adx_static)
+  return bignum__addmul_1_adx(r, a, n, b);
+#elif defined(bn__adx)
+  return bn__addmul_1_impl(r, a, n, b);
+#else
+  return bignum__addmul_1_generic(r, a, n, b);
+#endif
+}
+
+void bignum_init_cpu(void)
+{
+#if defined(bn__adx) && !defined(bn__adx_static)
+  // CPUID leaf 7 reports BMI2 in bit 8 and ADX in bit 19 of EBX.
+  uint32_t ebx = 0;
+#if defined(bn__adx_asm)
+  unsigned int eax, ecx, edx, b;
+  if(__get_cpuid_count(7, 0, &eax, &b, &ecx, &edx)) {
+    ebx = b;
+  }
+#else
+  int regs[4];
+  __cpuid(regs, 0);
+  if(regs[0] >= 7) {
+    __cpuidex(regs, 7, 0);
+    ebx = (uint32_t)regs[1];
+  }
+#endif
+  uint32_t const want = (UINT32_C(1) << 8) | (UINT32_C(1) << 19);
+  if((ebx & want) == want) {
+    bn__addmul_1_impl = bignum__addmul_1_adx;
+  }
+  else {
+    bn__addmul_1_impl = bignum__addmul_1_generic;
+  }
+#endif
+}
+
+char const* bignum_cpu_backend(void)
+{
+#if defined(bn__adx_static)
+  return "adx";
+#elif defined(bn__adx)
+  if(bn__addmul_1_impl == bignum__addmul_1_first) {
+    bignum_init_cpu();
+  }
+  return (bn__addmul_1_impl == bignum__addmul_1_adx)? "adx" : "generic";
+#else
+  return "generic";
+#endif
+}
+
+// Subtracts `b*a[0..n)` from `r[0..n)` and returns the word that has to be
+// borrowed from `r[n]`.
+static bn_word
+bignum__submul_1(bn_word *r, bn_word const *a, int n, bn_word b)
+{
+  bn_word borrow = 0;
+  for(int i = 0; i != n; ++i) {
+    bn_word hi;
+    bn_word lo = bignum__mulw(a[i], b, &hi);
+    hi += bignum__addc(lo, borrow, 0, &lo);
+    hi += bignum__subb(r[i], lo, 0, &r[i]);
+    borrow = hi;
+  }
+  return borrow;
+}
+
+// Stores `b*a[0..n) + c` to `r[0..n)` and returns the word that is carried
+// out of the top. `r` may be the same as `a`.
+static bn_word
+bignum__mul_1(bn_word *r, bn_word const *a, int n, bn_word b, bn_word c)
+{
+  bn_word carry = c;
+  for(int i = 0; i != n; ++i) {
+    bn_word hi;
+    bn_word lo = bignum__mulw(a[i], b, &hi);
+    hi += bignum__addc(lo, carry, 0, &r[i]);
+    carry = hi;
+  }
+  return carry;
+}
+
+// Adds `a[0..n)` to `r[0..n)` and returns the carry out of the top word.
+static bn_word
+bignum__add_n(bn_word *r, bn_word const *a, int n)
+{
+  bn_word carry = 0;
+  for(int i = 0; i != n; ++i) {
+    carry = bignum__addc(r[i], a[i], carry, &r[i]);
+  }
+  return carry;
+}
+
+// Subtracts `a[0..n)` from `r[0..n)` and returns the borrow out of the top
+// word.
+static bn_word
+bignum__sub_n(bn_word *r, bn_word const *a, int n)
+{
+  bn_word borrow = 0;
+  for(int i = 0; i != n; ++i) {
+    borrow = bignum__subb(r[i], a[i], borrow, &r[i]);
+  }
+  return borrow;
+}
+
+// Adds `a[0..an)` to `r[0..rn)`, where an <= rn, propagating the carry
+// through the rest of r. Returns the carry out of the top word.
+static bn_word
+bignum__add_into(bn_word *r, int rn, bn_word const *a, int an)
+{
+  bn_word carry = bignum__add_n(r, a, an);
+#if defined(bn_constant_time)
+  for(int i = an; i != rn; ++i) {
+    carry = bignum__addc(r[i], 0, carry, &r[i]);
+  }
+#else
+  for(int i = an; carry != 0 && i != rn; ++i) {
+    r[i] += 1;
+    carry = (r[i] == 0);
+  }
+#endif
+  return carry;
+}
+
+// Stores `|a[0..n) - b[0..bn)|` to `r[0..n)`, where bn <= n. Returns
+// non-zero if a is less than b.
+static int
+bignum__absdiff(bn_word *r, bn_word const *a, int n, bn_word const *b, int bn)
+{
+#if defined(bn_constant_time)
+  // Subtract over all n words, and negate the difference if it borrowed.
+  bn_word borrow = 0;
+  int i = 0;
+  for(; i != bn; ++i) {
+    borrow = bignum__subb(a[i], b[i], borrow, &r[i]);
+  }
+  for(; i != n; ++i) {
+    borrow = bignum__subb(a[i], 0, borrow, &r[i]);
+  }
+  bn_word mask = bignum__mask(borrow);
+  bn_word carry = borrow;
+  for(i = 0; i != n; ++i) {
+    carry = bignum__addc(r[i] ^ mask, 0, carry, &r[i]);
+  }
+  return (int)borrow;
+#else
+  int less = 0;
+  int i = n;
+  while(i-- > bn) {
+    if(a[i] != 0) break;
+  }
+  if(i < bn) {
+    i = bn;
+    while(i-- != 0) {
+      if(a[i] != b[i]) {
+        less = (a[i] < b[i]);
+        break;
+      }
+    }
+  }
+
+  bn_word const *x = less? b : a;
+  bn_word const *y = less? a : b;
+  bn_word borrow = 0;
+  for(i = 0; i != bn; ++i) {
+    borrow = bignum__subb(x[i], y[i], borrow, &r[i]);
+  }
+  // Past `bn` words only `a` may be non-zero, and if it is, it's the larger
+  // operand.
+  for(; i != n; ++i) {
+    bn_word ai = less? 0 : a[i];
+    r[i] = ai - borrow;
+    borrow = (ai < borrow);
+  }
+  return less;
+#endif
+}
+
+// Compares `a[0..n)` and `b[0..n)`, returns -1, 0 or 1. The top words
+// are tested first, as they usually decide it. The equal words below are
+// skipped in blocks, and the block that differs is scanned word by word.
+static int
+bignum__cmp_n(bn_word const *a, bn_word const *b, int n)
+{
+  if(n == 0) return 0;
+  if(a[n-1] != b[n-1]) {
+    return (a[n-1] > b[n-1])? 1 : -1;
+  }
+  int i = n-1;
+#if defined(bn__sse2)
+  int const step = 32 / (int)sizeof(bn_word);
+  while(i >= step) {
+    bn_word const *p = a + i - step;
+    bn_word const *q = b + i - step;
+    __m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i const *)p),
+                                 _mm_loadu_si128((__m128i const *)q));
+    __m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i const *)(p + step/2)),
+                                 _mm_loadu_si128((__m128i const *)(q + step/2)));
+    if(_mm_movemask_epi8(_mm_and_si128(lo, hi)) != 0xFFFF) break;
+    i -= step;
+  }
+#endif
+  while(i-- != 0) {
+    if(a[i] != b[i]) {
+      return (a[i] > b[i])? 1 : -1;
+    }
+  }
+  return 0;
+}
+
+// Stores `a[0..n)` shifted left by `s` bits, where 0 <= s < bn_word_bits,
+// to `r[0..n)` and returns the bits shifted out of the top. The words are
+// written from the top down, so `r` may overlap `a` from above. The right
+// shifts by bn_word_bits-s are split in two, so that s = 0 is defined.
+static bn_word
+bignum__lshift_n(bn_word *r, bn_word const *a, int n, int s)
+{
+  bn_word out = (a[n-1] >> 1) >> (bn_word_bits-1-s);
+  for(int i = n-1; i != 0; --i) {
+    r[i] = (a[i] << s) | ((a[i-1] >> 1) >> (bn_word_bits-1-s));
+  }
+  r[0] = a[0] << s;
+  return out;
+}
+
+// Stores `a[0..n)` shifted right by `s` bits, where 0 <= s < bn_word_bits,
+// to `r[0..n)`. The words are written from the bottom up, so `r` may
+// overlap `a` from below.
+static void
+bignum__rshift_n(bn_word *r, bn_word const *a, int n, int s)
+{
+  for(int i = 0; i != n-1; ++i) {
+    r[i] = (a[i] >> s) | ((a[i+1] << 1) << (bn_word_bits-1-s));
+  }
+  r[n-1] = a[n-1] >> s;
+}
+
+// Computes the full product of `a[0..an)` and `b[0..bn)` into r[0..an+bn).
+static void
+bignum__mul_basecase(bn_word *r, bn_word const *a, int an,
+                     bn_word const *b, int bn)
+{
+  for(int i = 0; i != bn; ++i) {
+    r[i] = 0;
+  }
+  for(int i = 0; i != an; ++i) {
+    r[i+bn] = bignum__addmul_1(r+i, b, bn, a[i]);
+  }
+}
+
+// Words of scratch space `bignum__mul_karatsuba` needs for operands of
+// up to bn_array_size words: each level takes 4*ceil(n/2) words and passes
+// the rest down to the next one.
+#define bn__karatsuba_scratch (6*bn_array_size + 64)
+
+// Adds the middle term of a Karatsuba product to `r`, which holds z0 in
+// r[0..2l) and z2 in r[2l..2n). `m` is |a0-a1|*|b1-b0| in 2l words, which
+// is subtracted if `negative` is non-zero. `t` takes 2l+1 words.
+static void
+bignum__karatsuba_combine(bn_word *r, bn_word const *m, int negative, int n,
+                          bn_word *t)
+{
+  int l = (n+1)/2;
+  int h = n - l;
+
+  // The middle term is z0 + z2 +- m, it is non-negative and fits in
+  // 2l+1 words.
+  for(int i = 0; i != 2*l; ++i) t[i] = r[i];
+  t[2*l] = bignum__add_into(t, 2*l, r+2*l, 2*h);
+#if defined(bn_constant_time)
+  // t - m is added as t + ~m + 1, which is B**2l too large.
+  bn_word mask = bignum__mask((bn_word)negative);
+  bn_word carry = (bn_word)negative;
+  for(int i = 0; i != 2*l; ++i) {
+    carry = bignum__addc(t[i], m[i] ^ mask, carry, &t[i]);
+  }
+  t[2*l] += carry - (bn_word)negative;
+#else
+  if(negative) {
+    t[2*l] -= bignum__sub_n(t, m, 2*l);
+  }
+  else {
+    t[2*l] += bignum__add_n(t, m, 2*l);
+  }
+#endif
+
+  int tn = 2*l + 1;
+  if(tn > 2*n - l) {
+    bn_assert(t[2*l] == 0);
+    tn = 2*n - l;
+  }
+  bignum__add_into(r+l, 2*n-l, t, tn);
+}
+
+// Computes the full product of `a[0..n)` and `b[0..n)` into r[0..2n).
+//
+// With a = a1*B^l + a0 and b = b1*B^l + b0 the product is
+//   z2*B^2l + (z0 + z2 + (a0-a1)*(b1-b0))*B^l + z0
+// where z0 = a0*b0 and z2 = a1*b1, so only three half-sized products are
+// needed. The differences are taken by absolute value, their signs are
+// tracked separately.
+static void
+bignum__mul_karatsuba(bn_word *r, bn_word const *a, bn_word const *b,
+                      int n, bn_word *scratch)
+{
+  if(n < bn_karatsuba_threshold) {
+    bignum__mul_basecase(r, a, n, b, n);
+    return;
+  }
+
+  int l = (n+1)/2;
+  int h = n - l;
+  bn_word *da = scratch;
+  bn_word *db = scratch + l;
+  bn_word *m = scratch + 2*l;
+  bn_word *next = scratch + 4*l;
+
+  bignum__mul_karatsuba(r, a, b, l, next);
+  if(h == l) {
+    bignum__mul_karatsuba(r+2*l, a+l, b+l, h, next);
+  }
+  else {
+    bignum__mul_basecase(r+2*l, a+l, h, b+l, h);
+  }
+
+  int negative = bignum__absdiff(da, a, l, a+l, h);
+  negative ^= bignum__absdiff(db, b, l, b+l, h) ^ 1;
+  bignum__mul_karatsuba(m, da, db, l, next);
+  bignum__karatsuba_combine(r, m, negative, n, next);
+}
+
+// Computes the square of `a[0..n)` into r[0..2n). Every cross product
+// a[i]*a[j] with i < j is computed once, the sum of them is doubled and the
+// squares of the words are added on the diagonal.
+static void
+bignum__sqr_basecase(bn_word *r, bn_word const *a, int n)
+{
+  for(int i = 0; i != 2*n; ++i) {
+    r[i] = 0;
+  }
+  for(int i = 0; i < n-1; ++i) {
+    r[i+n] = bignum__addmul_1(r+2*i+1, a+i+1, n-i-1, a[i]);
+  }
+
+  bn_word bit = 0;
+  for(int i = 0; i != 2*n; ++i) {
+    bn_word ri = r[i];
+    r[i] = (ri << 1) | bit;
+    bit = ri >> (bn_word_bits-1);
+  }
+
+  bn_word carry = 0;
+  for(int i = 0; i != n; ++i) {
+    bn_word hi;
+    bn_word lo = bignum__mulw(a[i], a[i], &hi);
+    carry = bignum__addc(r[2*i], lo, carry, &r[2*i]);
+    carry = bignum__addc(r[2*i+1], hi, carry, &r[2*i+1]);
+  }
+}
+
+// Computes the square of `a[0..n)` into r[0..2n). The Karatsuba identity
+// for squares is
+//   z2*B^2l + (z0 + z2 - (a0-a1)^2)*B^l + z0
+// where z0 = a0^2 and z2 = a1^2.
+static void
+bignum__sqr_karatsuba(bn_word *r, bn_word const *a, int n, bn_word *scratch)
+{
+  if(n < bn_karatsuba_threshold) {
+    bignum__sqr_basecase(r, a, n);
+    return;
+  }
+
+  int l = (n+1)/2;
+  int h = n - l;
+  bn_word *d = scratch;
+  bn_word *m = scratch + l;
+  bn_word *next = scratch + 3*l;
+
+  bignum__sqr_karatsuba(r, a, l, next);
+  if(h == l) {
+    bignum__sqr_karatsuba(r+2*l, a+l, h, next);
+  }
+  else {
+    bignum__sqr_basecase(r+2*l, a+l, h);
+  }
+
+  bignum__absdiff(d, a, l, a+l, h);
+  bignum__sqr_karatsuba(m, d, l, next);
+
+  bn_word *t = next;
+  for(int i = 0; i != 2*l; ++i) t[i] = r[i];
+  t[2*l] = bignum__add_into(t, 2*l, r+2*l, 2*h);
+  t[2*l] -= bignum__sub_n(t, m, 2*l);
+
+  int tn = 2*l + 1;
+  if(tn > 2*n - l) {
+    bn_assert(t[2*l] == 0);
+    tn = 2*n - l;
+  }
+  bignum__add_into(r+l, 2*n-l, t, tn);
+}
+
+// Computes the full product of `a[0..an)` and `b[0..bn)` into r[0..an+bn)
+// where an >= bn >= bn_karatsuba_threshold. The longer operand is cut into
+// bn-word pieces, which are multiplied by b with the Karatsuba kernel.
+static void
+bignum__mul_unbalanced(bn_word *r, bn_word const *a, int an,
+                       bn_word const *b, int bn, bn_word *tmp,
+                       bn_word *scratch)
+{
+  for(int i = 0; i != an+bn; ++i) {
+    r[i] = 0;
+  }
+  int k = 0;
+  for(; k + bn <= an; k += bn) {
+    bignum__mul_karatsuba(tmp, a+k, b, bn, scratch);
+    bignum__add_into(r+k, an+bn-k, tmp, 2*bn);
+  }
+  for(int i = k; i != an; ++i) {
+    r[i+bn] = bignum__addmul_1(r+i, b, bn, a[i]);
+  }
+}
+
+bn_word bignum_span_add(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(1 <= bn && bn <= an);
+
+  bn_word carry = 0;
+  int i = 0;
+  for(; i != bn; ++i) {
+    carry = bignum__addc(a[i], b[i], carry, &r[i]);
+  }
+  for(; i != an; ++i) {
+    carry = bignum__addc(a[i], 0, carry, &r[i]);
+  }
+  return carry;
+}
+
+bn_word bignum_span_sub(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(1 <= bn && bn <= an);
+
+  bn_word borrow = 0;
+  int i = 0;
+  for(; i != bn; ++i) {
+    borrow = bignum__subb(a[i], b[i], borrow, &r[i]);
+  }
+  for(; i != an; ++i) {
+    borrow = bignum__subb(a[i], 0, borrow, &r[i]);
+  }
+  return borrow;
+}
+
+void bignum_span_mul(bn_word* r, bn_word const* a, int an, bn_word const* b, int bn)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(1 <= an && an <= bn_array_size);
+  bn_assert(1 <= bn && bn <= bn_array_size);
+
+  if(an < bn) {
+    bn_word const *t = a;
+    a = b;
+    b = t;
+    int tn = an;
+    an = bn;
+    bn = tn;
+  }
+  if(bn >= bn_karatsuba_threshold) {
+    // The scratch space is taken from the stack, which for large
+    // bn_array_size is several kilobytes.
+    bn_word tmp[2*bn_array_size];
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__mul_unbalanced(r, a, an, b, bn, tmp, scratch);
+  }
+  else {
+    bignum__mul_basecase(r, a, an, b, bn);
+  }
+}
+
+void bignum_span_sqr(bn_word* r, bn_word const* a, int n)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(1 <= n && n <= bn_array_size);
+
+  if(n >= bn_karatsuba_threshold) {
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__sqr_karatsuba(r, a, n, scratch);
+  }
+  else {
+    bignum__sqr_basecase(r, a, n);
+  }
+}
+
+bn_word bignum_span_addmul_1(bn_word* r, bn_word const* a, int n, bn_word b)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(n >= 1);
+
+  return bignum__addmul_1(r, a, n, b);
+}
+
+bn_word bignum_span_submul_1(bn_word* r, bn_word const* a, int n, bn_word b)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(n >= 1);
+
+  return bignum__submul_1(r, a, n, b);
+}
+
+uint32_t bignum_incr_ex(Bignum* n)
+{
+  bn_assert(n);
+#if defined(bn_constant_time)
+  bn_word carry = 1;
+  for(int i = 0; i != bn_array_size; ++i) {
+    carry = bignum__addc(n->array[i], 0, carry, &n->array[i]);
+  }
+  return (uint32_t)carry;
+#else
+  int carry = 1;
+  int i;
+  for(i = 0; i != bn_array_size; ++i)
+  {
+    n->array[i] += carry;
+    if(n->array[i] != 0) {
+      carry = 0;
+      break;
+    }
+  }
+  // The increment either stops at word i, or wraps the value to zero.
+  int used = bignum__used(n);
+  bignum__set_length(n, carry? 0 : (i+1 > used)? i+1 : used);
+  return (uint32_t)carry;
+#endif
+}
+
+uint32_t bignum_decr_ex(Bignum* n)
+{
+  bn_assert(n);
+#if defined(bn_constant_time)
+  bn_word borrow = 1;
+  for(int i = 0; i != bn_array_size; ++i) {
+    borrow = bignum__subb(n->array[i], 0, borrow, &n->array[i]);
+  }
+  return (uint32_t)borrow;
+#else
+  int borrow = 1;
+  for(int i = 0; i != bn_array_size; ++i)
+  {
+    n->array[i] -= borrow;
+    if(n->array[i] != bn_max_val) {
+      borrow = 0;
+      break;
+    }
+  }
+  bignum__set_length(n, borrow? bn_array_size : bignum__used(n));
+  return (uint32_t)borrow;
+#endif
+}
+
+uint32_t bignum_add_ex(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  // A zero value with bn_track_length has no used words, but its first
+  // word is still there and zero.
+  int lused = bignum__used(lhs);
+  int rused = bignum__used(rhs);
+  if(lused == 0) lused = 1;
+  if(rused == 0) rused = 1;
+  int used = (lused > rused)? lused : rused;
+  bn__enter(bignum_op_add, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+
+  bn_word carry;
+  if(lused >= rused) {
+    carry = bignum_span_add(res->array, lhs->array, lused, rhs->array, rused);
+  }
+  else {
+    carry = bignum_span_add(res->array, rhs->array, rused, lhs->array, lused);
+  }
+  if(carry != 0 && used != bn_array_size) {
+    res->array[used++] = 1;
+    carry = 0;
+  }
+
+  bignum__finish(res, used);
+  bn__exit(bignum_op_add);
+  return (uint32_t)carry;
+}
+
+
+uint32_t bignum_sub_ex(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  int used = bignum__used(lhs);
+  if(bignum__used(rhs) > used) used = bignum__used(rhs);
+  if(used == 0) used = 1;
+  bn__enter(bignum_op_sub, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+
+  bn_word borrow = bignum_span_sub(res->array, lhs->array, used, rhs->array, used);
+  // A borrow out of the used words wraps the rest of the value.
+  if(borrow != 0) {
+    for(; used != bn_array_size; ++used) {
+      res->array[used] = (bn_word)bn_max_val;
+    }
+  }
+
+  bignum__finish(res, used);
+  bn__exit(bignum_op_sub);
+  return (uint32_t)borrow;
+}
+
+
+uint32_t bignum_mul_ex(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  int ldigits = bignum__secret_ndigits(lhs);
+  int rdigits = bignum__secret_ndigits(rhs);
+  bn__enter(bignum_op_mul, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+
+  if(ldigits >= bn_karatsuba_threshold && rdigits >= bn_karatsuba_threshold) {
+    bn_word wide[2*bn_array_size];
+    bignum_span_mul(wide, lhs->array, ldigits, rhs->array, rdigits);
+    int used = ldigits + rdigits;
+    int overflow = 0;
+    for(int i = bn_array_size; i < used; ++i) {
+      overflow |= (wide[i] != 0);
+    }
+    bignum__store(res, wide, (used < bn_array_size)? used : bn_array_size);
+    bn__exit(bignum_op_mul);
+    return (uint32_t)overflow;
+  }
+
+  // The product is accumulated in a temporary, so `res` may alias either
+  // of the operands. Products that land past the top word are not computed,
+  // the overflow is detected from the operand lengths and the carries that
+  // fall off the top instead.
+  int used = ldigits + rdigits;
+  if(used > bn_array_size) used = bn_array_size;
+  bn_word prod[bn_array_size];
+  for(int i = 0; i != used; ++i) {
+    prod[i] = 0;
+  }
+#if defined(bn_constant_time)
+  // The lengths are not known, but a product of two words that lands past
+  // the top is non-zero exactly when both words are. `any` tells if any of
+  // the words of rhs from bn_array_size-i up is non-zero.
+  int overflow = 0;
+  bn_word any = 0;
+  for(int i = 1; i != bn_array_size; ++i) {
+    any |= rhs->array[bn_array_size-i];
+    overflow |= (int)(bignum__nonzero(lhs->array[i]) & bignum__nonzero(any));
+  }
+#else
+  int overflow = (ldigits + rdigits - 1 > bn_array_size);
+#endif
+
+  for(int i = 0; i != ldigits; ++i) {
+    bn_word digit = lhs->array[i];
+#if !defined(bn_constant_time)
+    if(digit == 0) continue;
+#endif
+
+    int n = bn_array_size - i;
+    if(n > rdigits) n = rdigits;
+    bn_word carry = bignum__addmul_1(prod+i, rhs->array, n, digit);
+    if(i + n < bn_array_size) {
+      prod[i+n] = carry;
+    }
+    else {
+      overflow |= (carry != 0);
+    }
+  }
+
+  bignum__store(res, prod, used);
+  bn__exit(bignum_op_mul);
+  return (uint32_t)overflow;
+}
+
+uint32_t bignum_sqr_ex(Bignum* res, Bignum const* n)
+{
+  bn_assert(res);
+  bn_assert(n);
+
+  int ndigits = bignum__secret_ndigits(n);
+  bn__enter(bignum_op_sqr, bignum__get_ndigits(n));
+
+  bn_word wide[2*bn_array_size];
+  bignum_span_sqr(wide, n->array, ndigits);
+
+  int overflow = 0;
+  for(int i = bn_array_size; i < 2*ndigits; ++i) {
+    overflow |= (wide[i] != 0);
+  }
+  bignum__store(res, wide, (2*ndigits < bn_array_size)? 2*ndigits : bn_array_size);
+  bn__exit(bignum_op_sqr);
+  return (uint32_t)overflow;
+}
+
+uint32_t bignum_add_u32_ex(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+
+  int used = bignum__used(lhs);
+  if(used == 0) used = 1;
+  bn__enter(bignum_op_add_u32, bignum__get_ndigits(lhs));
+
+  // The carry only has to be propagated until it dies out, the rest of
+  // the words are copied unless the addition is in place.
+  bn_word carry = rhs;
+  int i = 0;
+#if defined(bn_constant_time)
+  for(; i != used; ++i) {
+#else
+  for(; i != used && carry != 0; ++i) {
+#endif
+    carry = bignum__addc(lhs->array[i], carry, 0, &res->array[i]);
+  }
+  if(res != lhs) {
+    for(; i != used; ++i) {
+      res->array[i] = lhs->array[i];
+    }
+  }
+  if(carry != 0 && used != bn_array_size) {
+    res->array[used++] = 1;
+    carry = 0;
+  }
+
+  bignum__finish(res, used);
+  bn__exit(bignum_op_add_u32);
+  return (uint32_t)carry;
+}
+
+uint32_t bignum_mul_u32_ex(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+
+  int used = bignum__used(lhs);
+  bn__enter(bignum_op_mul_u32, bignum__get_ndigits(lhs));
+  bn_word carry = bignum__mul_1(res->array, lhs->array, used, rhs, 0);
+  if(carry != 0 && used != bn_array_size) {
+    res->array[used++] = carry;
+    carry = 0;
+  }
+
+  bignum__finish(res, used);
+  bn__exit(bignum_op_mul_u32);
+  // The carry is less than `rhs`, so it fits the return type.
+  return (uint32_t)carry;
+}
+
+uint32_t bignum_muladd_ex(Bignum* res, Bignum const* lhs, Bignum const* rhs, Bignum const* add)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+  bn_assert(add);
+
+  int ldigits = bignum__secret_ndigits(lhs);
+  int rdigits = bignum__secret_ndigits(rhs);
+  int aused = bignum__used(add);
+  bn__enter(bignum_op_muladd, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs)
+                              + bignum__get_ndigits(add));
+
+  // The rows of the product are accumulated into a copy of `add`, so `res`
+  // may alias any of the operands. The sum has at most one word more than
+  // the longer of the product and `add`.
+  int used = ldigits + rdigits;
+  if(used < aused) used = aused;
+  used += 1;
+  if(used > bn_array_size) used = bn_array_size;
+  bn_word acc[bn_array_size];
+  for(int i = 0; i != aused; ++i) {
+    acc[i] = add->array[i];
+  }
+  for(int i = aused; i < used; ++i) {
+    acc[i] = 0;
+  }
+#if defined(bn_constant_time)
+  // Same as in `bignum_mul_ex`.
+  int overflow = 0;
+  bn_word any = 0;
+  for(int i = 1; i != bn_array_size; ++i) {
+    any |= rhs->array[bn_array_size-i];
+    overflow |= (int)(bignum__nonzero(lhs->array[i]) & bignum__nonzero(any));
+  }
+#else
+  int overflow = (ldigits + rdigits - 1 > bn_array_size);
+#endif
+
+  // The word carried out of row i goes to acc[i+n], where `add` may have
+  // left a value already. The carry out of that addition is a single bit
+  // kept in `pending`, it belongs one word up, where the next row's carry
+  // lands, so it's added together with it.
+  bn_word pending = 0;
+  int top = 0;
+  for(int i = 0; i != ldigits; ++i) {
+    int n = bn_array_size - i;
+    if(n > rdigits) n = rdigits;
+    bn_word digit = lhs->array[i];
+#if defined(bn_constant_time)
+    bn_word carry = bignum__addmul_1(acc+i, rhs->array, n, digit);
+#else
+    bn_word carry = (digit != 0)? bignum__addmul_1(acc+i, rhs->array, n, digit) : 0;
+#endif
+    top = i + n;
+    if(top < bn_array_size) {
+      pending = bignum__addc(acc[top], carry, pending, &acc[top]);
+      top += 1;
+    }
+    else {
+      overflow |= ((carry | pending) != 0);
+      pending = 0;
+    }
+  }
+  for(int i = top; i < used; ++i) {
+    pending = bignum__addc(acc[i], 0, pending, &acc[i]);
+  }
+  overflow |= (pending != 0);
+
+  bignum__store(res, acc, used);
+  bn__exit(bignum_op_muladd);
+  return (uint32_t)overflow;
+}
+
+uint32_t bignum_addmul_u32_ex(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+
+  int lused = bignum__used(lhs);
+  int rused = bignum__used(res);
+  if(lused == 0) {
+    return 0;
+  }
+  bn__enter(bignum_op_addmul_u32, bignum__get_ndigits(lhs) + bignum__get_ndigits(res));
+
+  bn_word carry = bignum__addmul_1(res->array, lhs->array, lused, rhs);
+  int used = (rused > lused)? rused : lused;
+  if(lused != bn_array_size) {
+    // lhs*rhs is less than B**(lused+1), so the sum can carry at most one
+    // bit out of the top.
+    carry = bignum__add_into(res->array + lused, bn_array_size - lused,
+                             &carry, 1);
+    if(used != bn_array_size) used += 1;
+  }
+
+  bignum__set_length(res, used);
+  bn__exit(bignum_op_addmul_u32);
+  return (uint32_t)carry;
+}
+
+void bignum_incr(Bignum* n)
+{
+  if(bignum_incr_ex(n) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_decr(Bignum* n)
+{
+  if(bignum_decr_ex(n) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_add(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  if(bignum_add_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_sub(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  if(bignum_sub_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_mul(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  if(bignum_mul_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_sqr(Bignum* res, Bignum const* n)
+{
+  if(bignum_sqr_ex(res, n) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_add_u32(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  if(bignum_add_u32_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_mul_wide(Bignum* lo, Bignum* hi, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(lo);
+  bn_assert(hi);
+  bn_assert(lhs);
+  bn_assert(rhs);
+  bn_assert(lo != hi);
+
+  int ldigits = bignum__secret_ndigits(lhs);
+  int rdigits = bignum__secret_ndigits(rhs);
+
+  bn__enter(bignum_op_mul_wide, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+
+  // The product is built in a temporary, so the halves may alias the
+  // operands.
+  bn_word wide[2*bn_array_size];
+  bignum_span_mul(wide, lhs->array, ldigits, rhs->array, rdigits);
+  int used = ldigits + rdigits;
+  if(used > bn_array_size) {
+    bignum__store(lo, wide, bn_array_size);
+    bignum__store(hi, wide + bn_array_size, used - bn_array_size);
+  }
+  else {
+    bignum__store(lo, wide, used);
+    bignum__finish(hi, 0);
+  }
+  bn__exit(bignum_op_mul_wide);
+}
+
+void bignum_muladd(Bignum* res, Bignum const* lhs, Bignum const* rhs, Bignum const* add)
+{
+  if(bignum_muladd_ex(res, lhs, rhs, add) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_addmul_u32(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  if(bignum_addmul_u32_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+void bignum_mul_u32(Bignum* res, Bignum const* lhs, uint32_t rhs)
+{
+  if(bignum_mul_u32_ex(res, lhs, rhs) != 0) {
+    bn_overflow_flag = 1;
+  }
+}
+
+// Divides `u[0..m)` by the single word `v`, the quotient is stored to `q`
+// and the remainder is returned.
+static bn_word
+bignum__divmod_1(bn_word *q, bn_word const *u, int m, bn_word v)
+{
+#if defined(bn_constant_time)
+  // The dividend is shifted along with the normalized divisor word by
+  // word. Shifting right by bn_word_bits-s is done in two steps, so that
+  // it's defined for s = 0 too.
+  int s = bignum__clz(v);
+  bn_word d = v << s;
+  bn_word rem;
+  bn_word inv = bignum__divw(~d, (bn_word)bn_max_val, d, &rem);
+  rem = (u[m-1] >> 1) >> (bn_word_bits-1-s);
+  int i = m;
+  while(i-- != 0) {
+    bn_word lo = u[i] << s;
+    if(i != 0) lo |= (u[i-1] >> 1) >> (bn_word_bits-1-s);
+    q[i] = bignum__divw_preinv(rem, lo, d, inv, &rem);
+  }
+  return rem >> s;
+#else
+  bn_word rem = 0;
+  int i = m;
+  while(i-- != 0) {
+    q[i] = bignum__divw(rem, u[i], v, &rem);
+  }
+  return rem;
+#endif
+}
+
+// Knuth's Algorithm D (TAOCP vol. 2, 4.3.1). Divides `u[0..m)` by `v[0..n)`,
+// where n >= 2, m >= n and the top word of v is non-zero. Quotient is
+// written to q[0..m-n] and the remainder to r[0..n). The dividend may be up
+// to 2*bn_array_size+1 words long, v up to bn_array_size.
+static void
+bignum__divmod_knuth(bn_word *q, bn_word *r,
+                     bn_word const *u, int m,
+                     bn_word const *v, int n)
+{
+  bn_assert(m <= 2*bn_array_size+1 && n <= bn_array_size);
+  bn_word un[2*bn_array_size+2];
+  bn_word vn[bn_array_size];
+
+  // Normalize, so that the top bit of the divisor is set. This guarantees
+  // that the estimated digit is at most 2 greater than the real one.
+  int s = bignum__clz(v[n-1]);
+  bignum__lshift_n(vn, v, n, s);
+  un[m] = bignum__lshift_n(un, u, m, s);
+
+  bn_word vtop = vn[n-1];
+  bn_word vnext = vn[n-2];
+#if defined(bn_constant_time)
+  bn_word vrem;
+  bn_word vinv = bignum__divw(~vtop, (bn_word)bn_max_val, vtop, &vrem);
+#endif
+  bn__count(div_steps, m-n+1);
+  for(int j = m-n; j >= 0; --j) {
+    // Estimate the quotient digit from the top two words of the current
+    // remainder, and correct it using the third word. The top word never
+    // exceeds vtop, if they are equal the estimate is clamped to B-1 and
+    // rhat is computed directly. Once rhat overflows a word, the test
+    // against the third word can't succeed anymore.
+    bn_word u2 = un[j+n];
+    bn_word u1 = un[j+n-1];
+    bn_word u0 = un[j+n-2];
+    bn_word qhat;
+    bn_word rhat;
+    bn_word rhat_over = 0;
+#if defined(bn_constant_time)
+    // Same as below, but the division is always done, with the top word
+    // cleared if it's equal to vtop, and the estimate is corrected exactly
+    // twice, which is the most it can be off by.
+    bn_word eq = bignum__mask(bignum__nonzero(u2 ^ vtop) ^ 1);
+    bn_word r1;
+    bn_word over = bignum__addc(u1, vtop, 0, &r1);
+    qhat = bignum__divw_preinv(u2 & ~eq, u1, vtop, vinv, &rhat);
+    qhat |= eq;
+    rhat ^= (rhat ^ r1) & eq;
+    rhat_over = over & eq;
+    for(int k = 0; k != 2; ++k) {
+      bn_word phi;
+      bn_word plo = bignum__mulw(qhat, vnext, &phi);
+      bn_word d;
+      bn_word borrow = bignum__subb(u0, plo, 0, &d);
+      borrow = bignum__subb(rhat, phi, borrow, &d);
+      bn_word fix = borrow & (rhat_over ^ 1);
+      qhat -= fix;
+      rhat_over |= bignum__addc(rhat, vtop & bignum__mask(fix), 0, &rhat);
+    }
+#else
+    if(u2 >= vtop) {
+      qhat = (bn_word)bn_max_val;
+      rhat_over = bignum__addc(u1, vtop, 0, &rhat);
+    }
+    else {
+      qhat = bignum__divw(u2, u1, vtop, &rhat);
+    }
+    while(rhat_over == 0) {
+      bn_word phi;
+      bn_word plo = bignum__mulw(qhat, vnext, &phi);
+      if(phi < rhat || (phi == rhat && plo <= u0)) break;
+      qhat -= 1;
+      bn__count(div_fixups, 1);
+      rhat_over = bignum__addc(rhat, vtop, 0, &rhat);
+    }
+#endif
+
+    bn_word borrow = bignum__submul_1(un+j, vn, n, qhat);
+    bn_word top = un[j+n];
+#if defined(bn_constant_time)
+    bn_word back = bignum__subb(top, borrow, 0, &un[j+n]);
+    bn_word mask = bignum__mask(back);
+    bn_word carry = 0;
+    for(int i = 0; i != n; ++i) {
+      carry = bignum__addc(un[j+i], vn[i] & mask, carry, &un[j+i]);
+    }
+    un[j+n] += carry;
+    qhat -= back;
+#else
+    un[j+n] = top - borrow;
+    if(top < borrow) {
+      // The estimate was still one too large, add one divisor back.
+      qhat -= 1;
+      bn__count(div_fixups, 1);
+      un[j+n] += bignum__add_n(un+j, vn, n);
+    }
+#endif
+    q[j] = qhat;
+  }
+
+  // Unnormalize the remainder.
+  bignum__rshift_n(r, un, n, s);
+}
+
+void bignum_span_divmod(bn_word* q, bn_word* r, bn_word const* a, int an, bn_word const* b, int bn)
+{
+  bn_assert(q);
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(1 <= bn && bn <= an);
+  bn_assert(b[bn-1] != 0);
+
+  if(bn == 1) {
+    r[0] = bignum__divmod_1(q, a, an, b[0]);
+  }
+  else {
+    bignum__divmod_knuth(q, r, a, an, b, bn);
+  }
+}
+
+void
+bignum_divmod(Bignum* quot, Bignum *rem, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(lhs);
+  bn_assert(rhs);
+  bn_assert(quot);
+  bn_assert(rem);
+  bn_assert(quot != rem);
+
+  if(bignum_is_zero(rhs)) {
+    bn_assert(0);
+    return;
+  }
+
+  bn__enter(bignum_op_divmod, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+#if !defined(bn_constant_time)
+  if(bignum_cmp(lhs, rhs) == -1) {
+    bignum_assign(rem, lhs);
+    bignum_from_u64(quot, 0);
+    bn__exit(bignum_op_divmod);
+    return;
+  }
+#endif
+
+  // The results are built in temporaries, so `quot` and `rem` may alias
+  // either of the operands.
+  bn_word quotient[bn_array_size];
+  bn_word remainder[bn_array_size];
+
+  int ldigits = bignum__secret_ndigits(lhs);
+  int rdigits = bignum__get_ndigits(rhs);
+
+  bignum_span_divmod(quotient, remainder,
+                     lhs->array, ldigits, rhs->array, rdigits);
+  bignum__store(quot, quotient, ldigits-rdigits+1);
+  bignum__store(rem, remainder, rdigits);
+  bn__exit(bignum_op_divmod);
+}
+
+uint32_t bignum_divmod_u32(Bignum* quot, Bignum const* lhs, uint32_t rhs)
+{
+  bn_assert(quot);
+  bn_assert(lhs);
+
+  if(rhs == 0) {
+    bn_assert(0);
+    return 0;
+  }
+
+  // The division goes from the top word down, so it can work in place.
+  int used = bignum__used(lhs);
+  bn__enter(bignum_op_divmod_u32, bignum__get_ndigits(lhs));
+  bn_word rem = bignum__divmod_1(quot->array, lhs->array, used, rhs);
+  bignum__finish(quot, used);
+  bn__exit(bignum_op_divmod_u32);
+  return (uint32_t)rem;
+}
+
+int bignum_bit_length(Bignum const* n)
+{
+  bn_assert(n);
+
+  int ndigits = bignum__get_ndigits(n);
+  bn_word top = n->array[ndigits-1];
+  if(top == 0) return 0;
+  return bn_word_bits*ndigits - bignum__clz(top);
+}
+
+bn_word bignum_span_lshift(bn_word* r, bn_word const* a, int n, int nbits)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(n >= 1);
+  bn_assert(0 <= nbits && nbits < bn_word_bits);
+
+  return bignum__lshift_n(r, a, n, nbits);
+}
+
+void bignum_span_rshift(bn_word* r, bn_word const* a, int n, int nbits)
+{
+  bn_assert(r);
+  bn_assert(a);
+  bn_assert(n >= 1);
+  bn_assert(0 <= nbits && nbits < bn_word_bits);
+
+  bignum__rshift_n(r, a, n, nbits);
+}
+
+void bignum_lshift(Bignum* res, Bignum const* n, int nbits)
+{
+  bn_assert(res);
+  bn_assert(n);
+  bn_assert(nbits >= 0);
+  bn__enter(bignum_op_lshift, bignum__get_ndigits(n));
+
+  int bits = bignum_bit_length(n);
+  if(bits != 0 && nbits > bn_word_bits*bn_array_size - bits) {
+    bn_overflow_flag = 1;
+  }
+  if(nbits >= bn_word_bits*bn_array_size) {
+    bignum__finish(res, 0);
+    bn__exit(bignum_op_lshift);
+    return;
+  }
+
+  // The words are moved from the top down, so `res` may be `n`. The word
+  // shifted out of the top of the source words is stored above them, if
+  // there's room for it.
+  int words = nbits / bn_word_bits;
+  int used = bignum__used(n);
+  if(used > bn_array_size - words) used = bn_array_size - words;
+  int top = words;
+  if(used != 0) {
+    bn_word out = bignum_span_lshift(res->array + words, n->array, used,
+                                     nbits % bn_word_bits);
+    top = words + used;
+    if(top != bn_array_size) {
+      res->array[top++] = out;
+    }
+  }
+  for(int i = 0; i != words; ++i) {
+    res->array[i] = 0;
+  }
+  bignum__finish(res, top);
+  bn__exit(bignum_op_lshift);
+}
+
+void bignum_rshift(Bignum* res, Bignum const* n, int nbits)
+{
+  bn_assert(res);
+  bn_assert(n);
+  bn_assert(nbits >= 0);
+
+  int words = nbits / bn_word_bits;
+  int used = bignum__used(n);
+  bn__enter(bignum_op_rshift, bignum__get_ndigits(n));
+  if(nbits >= bn_word_bits*bn_array_size || words >= used) {
+    bignum__finish(res, 0);
+    bn__exit(bignum_op_rshift);
+    return;
+  }
+
+  // The words are moved from the bottom up, so `res` may be `n`.
+  bignum_span_rshift(res->array, n->array + words, used - words,
+                     nbits % bn_word_bits);
+  bignum__finish(res, used - words);
+  bn__exit(bignum_op_rshift);
+}
+
+void bignum_and(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  int used = bignum__used(lhs);
+  if(bignum__used(rhs) < used) used = bignum__used(rhs);
+  for(int i = 0; i != used; ++i) {
+    res->array[i] = lhs->array[i] & rhs->array[i];
+  }
+  bignum__finish(res, used);
+}
+
+void bignum_or(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  int used = bignum__used(lhs);
+  if(bignum__used(rhs) > used) used = bignum__used(rhs);
+  for(int i = 0; i != used; ++i) {
+    res->array[i] = lhs->array[i] | rhs->array[i];
+  }
+  bignum__finish(res, used);
+}
+
+void bignum_xor(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
+
+  int used = bignum__used(lhs);
+  if(bignum__used(rhs) > used) used = bignum__used(rhs);
+  for(int i = 0; i != used; ++i) {
+    res->array[i] = lhs->array[i] ^ rhs->array[i];
+  }
+  bignum__finish(res, used);
+}
+
+void bignum_not(Bignum* res, Bignum const* n)
+{
+  bn_assert(res);
+  bn_assert(n);
+
+  for(int i = 0; i != bn_array_size; ++i) {
+    res->array[i] = ~n->array[i];
+  }
+  bignum__finish(res, bn_array_size);
+}
+
+// Shifts the non-zero `x[0..*n)` right by the number of its trailing zero
+// bits, which is returned, and updates `n` to its new length.
+static int
+bignum__strip_twos(bn_word *x, int *n)
+{
+  int words = 0;
+  while(x[words] == 0) {
+    ++words;
+  }
+  int s = bignum__ctz(x[words]);
+  int len = *n - words;
+  bignum__rshift_n(x, x + words, len, s);
+  if(x[len-1] == 0) --len;
+  *n = len;
+  return bn_word_bits*words + s;
+}
+
+void bignum_gcd(Bignum* res, Bignum const* a, Bignum const* b)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(b);
+  bn__enter(bignum_op_gcd, bignum__get_ndigits(a) + bignum__get_ndigits(b));
+
+  if(bignum_is_zero(a)) {
+    bignum_assign(res, b);
+    bn__exit(bignum_op_gcd);
+    return;
+  }
+  if(bignum_is_zero(b)) {
+    bignum_assign(res, a);
+    bn__exit(bignum_op_gcd);
+    return;
+  }
+
+  bn_word x[bn_array_size];
+  bn_word y[bn_array_size];
+  int xn = bignum__get_ndigits(a);
+  int yn = bignum__get_ndigits(b);
+  for(int i = 0; i != xn; ++i) x[i] = a->array[i];
+  for(int i = 0; i != yn; ++i) y[i] = b->array[i];
+
+  // gcd(2**i*u, 2**j*v) = 2**min(i,j)*gcd(u, v). With both values odd,
+  // their difference is even, so it can be stripped further.
+  int xs = bignum__strip_twos(x, &xn);
+  int ys = bignum__strip_twos(y, &yn);
+  int shift = (xs < ys)? xs : ys;
+
+  bn_word *u = x;
+  bn_word *v = y;
+  int un = xn;
+  int vn = yn;
+  for(;;) {
+    int c = (un != vn)? ((un > vn)? 1 : -1) : bignum__cmp_n(u, v, un);
+    if(c == 0) break;
+    if(c > 0) {
+      bn_word *t = u; u = v; v = t;
+      int tn = un; un = vn; vn = tn;
+    }
+
+    // Here u < v, so the borrow dies out before the top of v.
+    bn_word borrow = bignum__sub_n(v, u, un);
+    for(int i = un; borrow != 0; ++i) {
+      borrow = bignum__subb(v[i], 0, borrow, &v[i]);
+    }
+    while(v[vn-1] == 0) --vn;
+    bignum__strip_twos(v, &vn);
+  }
+
+  Bignum g;
+  bignum_init(&g);
+  bignum__store(&g, u, un);
+  bignum_lshift(res, &g, shift);
+  bn__exit(bignum_op_gcd);
+}
+
+void bignum_lcm(Bignum* res, Bignum const* a, Bignum const* b)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(b);
+  bn__enter(bignum_op_lcm, bignum__get_ndigits(a) + bignum__get_ndigits(b));
+
+  if(bignum_is_zero(a) || bignum_is_zero(b)) {
+    bignum_from_u64(res, 0);
+    bn__exit(bignum_op_lcm);
+    return;
+  }
+
+  // a/gcd*b, dividing first keeps the intermediate value in range.
+  Bignum g;
+  bignum_init(&g);
+  bignum_gcd(&g, a, b);
+  Bignum q;
+  bignum_init(&q);
+  Bignum r;
+  bignum_init(&r);
+  bignum_divmod(&q, &r, a, &g);
+  bignum_mul(res, &q, b);
+  bn__exit(bignum_op_lcm);
+}
+
+#if defined(bn_constant_time)
+// Inverse of `a[0..n)` modulo the odd `m[0..n)`, where a < m. Keeps
+// x = u*a and y = v*a modulo m, starting from x = a and y = m. In every
+// step, if x is odd, the smaller of x and y is subtracted from the larger
+// one and x is made the difference, then x is halved. The product x*y is at
+// least halved every step, so after 2*bn_word_bits*n steps x is zero and y
+// is the gcd. Returns 1 and stores v to `r` if the gcd is one.
+static int
+bignum__modinv_ct(bn_word *r, bn_word const *a, bn_word const *m, int n)
+{
+  bn_word x[bn_array_size];
+  bn_word y[bn_array_size];
+  bn_word u[bn_array_size];
+  bn_word v[bn_array_size];
+  for(int i = 0; i != n; ++i) {
+    x[i] = a[i];
+    y[i] = m[i];
+    u[i] = 0;
+    v[i] = 0;
+  }
+  u[0] = 1;
+
+  for(int step = 0; step != 2*bn_word_bits*n; ++step) {
+    bn_word odd = x[0] & 1;
+    bn_word swap = bignum__mask(odd & bignum__less_n(x, y, n));
+    bignum__cswap_n(x, y, n, swap);
+    bignum__cswap_n(u, v, n, swap);
+
+    // x -= y and u -= v mod m, if x is odd.
+    bn_word mask = bignum__mask(odd);
+    bn_word borrow = 0;
+    for(int i = 0; i != n; ++i) {
+      borrow = bignum__subb(x[i], y[i] & mask, borrow, &x[i]);
+    }
+    borrow = 0;
+    for(int i = 0; i != n; ++i) {
+      borrow = bignum__subb(u[i], v[i] & mask, borrow, &u[i]);
+    }
+    mask = bignum__mask(borrow);
+    bn_word carry = 0;
+    for(int i = 0; i != n; ++i) {
+      carry = bignum__addc(u[i], m[i] & mask, carry, &u[i]);
+    }
+
+    // x is even now. u/2 mod m is (u + m)/2 if u is odd, the carry out of
+    // the sum goes into the top bit.
+    bignum__rshift_n(x, x, n, 1);
+    mask = bignum__mask(u[0] & 1);
+    carry = 0;
+    for(int i = 0; i != n; ++i) {
+      carry = bignum__addc(u[i], m[i] & mask, carry, &u[i]);
+    }
+    bignum__rshift_n(u, u, n, 1);
+    u[n-1] |= carry << (bn_word_bits-1);
+  }
+
+  bn_word diff = y[0] ^ 1;
+  for(int i = 1; i != n; ++i) {
+    diff |= y[i];
+  }
+  bn_word one = bignum__nonzero(diff) ^ 1;
+  bn_word mask = bignum__mask(one);
+  for(int i = 0; i != n; ++i) {
+    r[i] = v[i] & mask;
+  }
+  return (int)one;
+}
+#endif
+
+int bignum_modinv(Bignum* res, Bignum const* a, Bignum const* m)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(m);
+  bn_assert(!bignum_is_zero(m));
+  bn__enter(bignum_op_modinv, bignum__get_ndigits(a) + bignum__get_ndigits(m));
+
+  Bignum q;
+  bignum_init(&q);
+  Bignum reduced;
+  bignum_init(&reduced);
+  bignum_divmod(&q, &reduced, a, m);
+
+#if defined(bn_constant_time)
+  if(m->array[0] & 1) {
+    bn_word inv[bn_array_size];
+    int n = bignum__get_ndigits(m);
+    int found = bignum__modinv_ct(inv, reduced.array, m->array, n);
+    bignum__store(res, inv, n);
+    bn__exit(bignum_op_modinv);
+    return found;
+  }
+#endif
+
+  // Euclid's algorithm on word spans, with three buffers for the
+  // remainders and three for the coefficients of a, which rotate every
+  // step. The coefficients are kept as absolute values, t = t0 + q*t1,
+  // their signs alternate, so after an even number of steps t0 is
+  // negative. They never get above m.
+  bn_word rbuf[3][bn_array_size];
+  bn_word tbuf[3][2*bn_array_size];
+  bn_word quotient[bn_array_size];
+  bn_word *r0 = rbuf[0], *r1 = rbuf[1], *r2 = rbuf[2];
+  bn_word *t0 = tbuf[0], *t1 = tbuf[1], *t2 = tbuf[2];
+  int n0 = bignum__get_ndigits(m);
+  int n1 = bignum__get_ndigits(&reduced);
+  for(int i = 0; i != n0; ++i) r0[i] = m->array[i];
+  for(int i = 0; i != n1; ++i) r1[i] = reduced.array[i];
+  if(r1[n1-1] == 0) n1 = 0;
+  t0[0] = 0;
+  t1[0] = 1;
+  int tn0 = 1;
+  int tn1 = 1;
+  int steps = 0;
+  while(n1 != 0) {
+    int qn = n0 - n1 + 1;
+    int n2 = n1;
+    if(n1 == 1) {
+      r2[0] = bignum__divmod_1(quotient, r0, n0, r1[0]);
+      qn = n0;
+    }
+    else {
+      bignum__divmod_knuth(quotient, r2, r0, n0, r1, n1);
+    }
+    while(qn != 1 && quotient[qn-1] == 0) --qn;
+    while(n2 != 0 && r2[n2-1] == 0) --n2;
+
+    bignum__mul_basecase(t2, quotient, qn, t1, tn1);
+    int tn2 = qn + tn1;
+    bignum__add_into(t2, tn2, t0, tn0);
+    while(tn2 != 1 && t2[tn2-1] == 0) --tn2;
+
+    bn_word *r = r0; r0 = r1; r1 = r2; r2 = r;
+    bn_word *t = t0; t0 = t1; t1 = t2; t2 = t;
+    n0 = n1; n1 = n2;
+    tn0 = tn1; tn1 = tn2;
+    ++steps;
+  }
+
+  if(n0 != 1 || r0[0] != 1) {
+    bignum_from_u64(res, 0);
+    bn__exit(bignum_op_modinv);
+    return 0;
+  }
+  Bignum x;
+  bignum_init(&x);
+  bignum__store(&x, t0, tn0);
+  if(steps % 2 == 0 && !bignum_is_zero(&x)) {
+    bignum_sub(&x, m, &x);
+  }
+  bignum_assign(res, &x);
+  bn__exit(bignum_op_modinv);
+  return 1;
+}
+
+// Stores x**e to `res` by repeated squaring and returns non-zero value if
+// it doesn't fit.
+static uint32_t
+bignum__pow_ex(Bignum *res, Bignum const *x, int e)
+{
+  Bignum acc;
+  bignum_from_u64(&acc, 1);
+  Bignum b;
+  bignum_init(&b);
+  bignum_assign(&b, x);
+  uint32_t overflow = 0;
+  while(e != 0) {
+    if(e & 1) {
+      overflow |= bignum_mul_ex(&acc, &acc, &b);
+    }
+    e >>= 1;
+    if(e != 0) {
+      overflow |= bignum_sqr_ex(&b, &b);
+    }
+  }
+  bignum_assign(res, &acc);
+  return overflow;
+}
+
+void bignum_iroot(Bignum* res, Bignum const* a, int k)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(k >= 1);
+
+  bn__enter(bignum_op_iroot, bignum__get_ndigits(a));
+
+  int bits = bignum_bit_length(a);
+  if(k == 1 || bits <= 1) {
+    bignum_assign(res, a);
+    bn__exit(bignum_op_iroot);
+    return;
+  }
+
+  // x = 2**ceil(bits/k) is not less than the root. From above, Newton's
+  // step  x' = ((k-1)*x + q)/k  with  q = a/x**(k-1)  decreases strictly
+  // down to the rounded root, and stops there as q is no longer below x.
+  // Written as  x' = x - ceil((x-q)/k)  the step can't overflow.
+  Bignum x;
+  bignum_from_u64(&x, 1);
+  bignum_lshift(&x, &x, (bits + k - 1)/k);
+  Bignum y;
+  bignum_init(&y);
+  Bignum q;
+  bignum_init(&q);
+  Bignum r;
+  bignum_init(&r);
+  for(;;) {
+    if(k == 2) {
+      bignum_divmod(&q, &r, a, &x);
+    }
+    else if(bignum__pow_ex(&y, &x, k-1) == 0) {
+      bignum_divmod(&q, &r, a, &y);
+    }
+    else {
+      // The power doesn't fit, so it's bigger than a.
+      bignum_from_u64(&q, 0);
+    }
+    if(bignum_cmp(&q, &x) >= 0) break;
+    bignum_sub_ex(&y, &x, &q);
+    bignum_add_u32_ex(&y, &y, (uint32_t)(k-1));
+    bignum_divmod_u32(&y, &y, (uint32_t)k);
+    bignum_sub_ex(&x, &x, &y);
+  }
+  bignum_assign(res, &x);
+  bn__exit(bignum_op_iroot);
+}
+
+void bignum_isqrt(Bignum* res, Bignum const* a)
+{
+  bignum_iroot(res, a, 2);
+}
+
+int bignum_is_square(Bignum const* a)
+{
+  bn_assert(a);
+  bn__enter(bignum_op_is_square, bignum__get_ndigits(a));
+
+  // Bit i of each mask is set if i is a square modulo 64, 63, 5, 13, 11
+  // and 17, the product of the odd ones is 765765.
+  if(((UINT64_C(0x0202021202030213) >> (a->array[0] & 63)) & 1) == 0) {
+    bn__exit(bignum_op_is_square);
+    return 0;
+  }
+  Bignum q;
+  bignum_init(&q);
+  uint32_t r = bignum_divmod_u32(&q, a, 765765);
+  if(((UINT64_C(0x0402483012450293) >> (r % 63)) & 1) == 0 ||
+     ((UINT32_C(0x13) >> (r % 5)) & 1) == 0 ||
+     ((UINT32_C(0x161b) >> (r % 13)) & 1) == 0 ||
+     ((UINT32_C(0x23b) >> (r % 11)) & 1) == 0 ||
+     ((UINT32_C(0x1a317) >> (r % 17)) & 1) == 0) {
+    bn__exit(bignum_op_is_square);
+    return 0;
+  }
+
+  Bignum s;
+  bignum_init(&s);
+  bignum_isqrt(&s, a);
+  bignum_sqr_ex(&s, &s);
+  int square = bignum_equal(&s, a);
+  bn__exit(bignum_op_is_square);
+  return square;
+}
+
+// Odd primes below 2048, for trial division and sieving.
+#define bn__small_prime_count 308
+static uint16_t const bn__small_primes[bn__small_prime_count] = {
+     3,    5,    7,   11,   13,   17,   19,   23,   29,   31,   37,   41,
+    43,   47,   53,   59,   61,   67,   71,   73,   79,   83,   89,   97,
+   101,  103,  107,  109,  113,  127,  131,  137,  139,  149,  151,  157,
+   163,  167,  173,  179,  181,  191,  193,  197,  199,  211,  223,  227,
+   229,  233,  239,  241,  251,  257,  263,  269,  271,  277,  281,  283,
+   293,  307,  311,  313,  317,  331,  337,  347,  349,  353,  359,  367,
+   373,  379,  383,  389,  397,  401,  409,  419,  421,  431,  433,  439,
+   443,  449,  457,  461,  463,  467,  479,  487,  491,  499,  503,  509,
+   521,  523,  541,  547,  557,  563,  569,  571,  577,  587,  593,  599,
+   601,  607,  613,  617,  619,  631,  641,  643,  647,  653,  659,  661,
+   673,  677,  683,  691,  701,  709,  719,  727,  733,  739,  743,  751,
+   757,  761,  769,  773,  787,  797,  809,  811,  821,  823,  827,  829,
+   839,  853,  857,  859,  863,  877,  881,  883,  887,  907,  911,  919,
+   929,  937,  941,  947,  953,  967,  971,  977,  983,  991,  997, 1009,
+  1013, 1019, 1021, 1031, 1033, 1039, 1049, 1051, 1061, 1063, 1069, 1087,
+  1091, 1093, 1097, 1103, 1109, 1117, 1123, 1129, 1151, 1153, 1163, 1171,
+  1181, 1187, 1193, 1201, 1213, 1217, 1223, 1229, 1231, 1237, 1249, 1259,
+  1277, 1279, 1283, 1289, 1291, 1297, 1301, 1303, 1307, 1319, 1321, 1327,
+  1361, 1367, 1373, 1381, 1399, 1409, 1423, 1427, 1429, 1433, 1439, 1447,
+  1451, 1453, 1459, 1471, 1481, 1483, 1487, 1489, 1493, 1499, 1511, 1523,
+  1531, 1543, 1549, 1553, 1559, 1567, 1571, 1579, 1583, 1597, 1601, 1607,
+  1609, 1613, 1619, 1621, 1627, 1637, 1657, 1663, 1667, 1669, 1693, 1697,
+  1699, 1709, 1721, 1723, 1733, 1741, 1747, 1753, 1759, 1777, 1783, 1787,
+  1789, 1801, 1811, 1823, 1831, 1847, 1861, 1867, 1871, 1873, 1877, 1879,
+  1889, 1901, 1907, 1913, 1931, 1933, 1949, 1951, 1973, 1979, 1987, 1993,
+  1997, 1999, 2003, 2011, 2017, 2027, 2029, 2039,
+};
+
+// Number of odd numbers in a window of `bignum_next_prime`'s sieve.
+#define bn__sieve_size 1024
+
+// Returns `u[0..m)` modulo the word `v`.
+static bn_word
+bignum__mod_1(bn_word const *u, int m, bn_word v)
+{
+  bn_word rem = 0;
+  int i = m;
+  while(i-- != 0) {
+    bignum__divw(rem, u[i], v, &rem);
+  }
+  return rem;
+}
+
+// Stores `u[0..m)` modulo every small prime to `rem`. The primes are taken
+// in groups whose product fits a word, every group takes one pass over u.
+static void
+bignum__small_residues(uint32_t *rem, bn_word const *u, int m)
+{
+  int i = 0;
+  while(i != bn__small_prime_count) {
+    bn_word prod = bn__small_primes[i];
+    int j = i + 1;
+    while(j != bn__small_prime_count &&
+          prod <= (bn_word)bn_max_val / bn__small_primes[j]) {
+      prod *= bn__small_primes[j++];
+    }
+    bn_word r = bignum__mod_1(u, m, prod);
+    for(; i != j; ++i) {
+      rem[i] = (uint32_t)(r % bn__small_primes[i]);
+    }
+  }
+}
+
+// The bodies of the prime functions, which return from many places. The
+// public functions below wrap them in bn__enter and bn__exit.
+static int
+bignum__miller_rabin(Bignum const *n, Bignum const *base)
+{
+  // The values are compared in Montgomery form, where 1 is R mod n and
+  // -1 is n minus that.
+  BignumMont ctx;
+  bignum_mont_init(&ctx, n);
+  Bignum one;
+  bignum_from_u64(&one, 1);
+  bignum_to_mont(&one, &one, &ctx);
+  Bignum minus_one;
+  bignum_init(&minus_one);
+  bignum_sub_ex(&minus_one, n, &one);
+
+  // A base that is 0 or -1 modulo n says nothing.
+  Bignum y;
+  bignum_init(&y);
+  bignum_to_mont(&y, base, &ctx);
+  if(bignum_is_zero(&y) || bignum_equal(&y, &one) ||
+     bignum_equal(&y, &minus_one)) {
+    return 1;
+  }
+
+  // n - 1 = d*2**s with d odd.
+  Bignum d;
+  bignum_init(&d);
+  bignum_assign(&d, n);
+  d.array[0] -= 1;
+  int s = 0;
+  while(((d.array[s/bn_word_bits] >> (s%bn_word_bits)) & 1) == 0) {
+    s += 1;
+  }
+  bignum_rshift(&d, &d, s);
+
+  bignum_from_mont(&y, &y, &ctx);
+  bignum_modexp(&y, &y, &d, &ctx);
+  bignum_to_mont(&y, &y, &ctx);
+  if(bignum_equal(&y, &one) || bignum_equal(&y, &minus_one)) {
+    return 1;
+  }
+  for(int r = 1; r < s; ++r) {
+    bignum_mont_sqr(&y, &y, &ctx);
+    if(bignum_equal(&y, &minus_one)) return 1;
+    if(bignum_equal(&y, &one)) return 0;
+  }
+  return 0;
+}
+
+// Miller-Rabin with the fixed bases, for odd n above the small primes.
+static int
+bignum__miller_rabin_rounds(Bignum const *n, int rounds)
+{
+  Bignum base;
+  bignum_init(&base);
+  for(int i = 0; i != rounds; ++i) {
+    bignum_from_u64(&base, (i == 0)? 2 : bn__small_primes[i-1]);
+    if(!bignum__miller_rabin(n, &base)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int
+bignum__is_probable_prime(Bignum const *n, int rounds)
+{
+  uint32_t const last = bn__small_primes[bn__small_prime_count-1];
+  int small = (bignum_bit_length(n) <= 32);
+  uint64_t value = small? u64_from_bignum(n) : 0;
+  if(small && value <= last) {
+    if(value == 2) return 1;
+    if(value < 3 || (value & 1) == 0) return 0;
+    for(int i = 0; i != bn__small_prime_count; ++i) {
+      if(bn__small_primes[i] == value) return 1;
+    }
+    return 0;
+  }
+  if((n->array[0] & 1) == 0) {
+    return 0;
+  }
+
+  uint32_t rem[bn__small_prime_count];
+  bignum__small_residues(rem, n->array, bignum__get_ndigits(n));
+  for(int i = 0; i != bn__small_prime_count; ++i) {
+    if(rem[i] == 0) return 0;
+  }
+  if(small && value < (uint64_t)last*last) {
+    return 1;
+  }
+  return bignum__miller_rabin_rounds(n, rounds);
+}
+
+static void
+bignum__next_prime(Bignum *res, Bignum const *a, int rounds)
+{
+  // Below the last small prime the answer comes from the table.
+  uint32_t const last = bn__small_primes[bn__small_prime_count-1];
+  if(bignum_bit_length(a) <= 32 && u64_from_bignum(a) < last) {
+    uint64_t value = u64_from_bignum(a);
+    int i = 0;
+    while(bn__small_primes[i] <= value) ++i;
+    bignum_from_u64(res, (value < 2)? 2 : bn__small_primes[i]);
+    return;
+  }
+
+  // c is the first odd number above a, candidate k of a window is c + 2k.
+  Bignum c;
+  bignum_init(&c);
+  if(bignum_add_u32_ex(&c, a, 1 + (a->array[0] & 1)) != 0) {
+    bignum_from_u64(res, 0);
+    bn_overflow_flag = 1;
+    return;
+  }
+  uint32_t rem[bn__small_prime_count];
+  bignum__small_residues(rem, c.array, bignum__get_ndigits(&c));
+
+  Bignum n;
+  bignum_init(&n);
+  for(;;) {
+    // c + 2k is divisible by p if 2k = -c mod p, so k = -c/2 mod p and the
+    // ones p apart from it are crossed out.
+    uint8_t composite[bn__sieve_size];
+    for(int k = 0; k != bn__sieve_size; ++k) {
+      composite[k] = 0;
+    }
+    for(int i = 0; i != bn__small_prime_count; ++i) {
+      uint32_t p = bn__small_primes[i];
+      uint32_t k = (p - rem[i]) % p * ((p+1)/2) % p;
+      for(; k < bn__sieve_size; k += p) {
+        composite[k] = 1;
+      }
+    }
+
+    for(int k = 0; k != bn__sieve_size; ++k) {
+      if(composite[k]) continue;
+      if(bignum_add_u32_ex(&n, &c, (uint32_t)(2*k)) != 0) {
+        bignum_from_u64(res, 0);
+        bn_overflow_flag = 1;
+        return;
+      }
+      if(bignum__miller_rabin_rounds(&n, rounds)) {
+        bignum_assign(res, &n);
+        return;
+      }
+    }
+
+    if(bignum_add_u32_ex(&c, &c, 2*bn__sieve_size) != 0) {
+      bignum_from_u64(res, 0);
+      bn_overflow_flag = 1;
+      return;
+    }
+    for(int i = 0; i != bn__small_prime_count; ++i) {
+      rem[i] = (rem[i] + 2*bn__sieve_size) % bn__small_primes[i];
+    }
+  }
+}
+
+int bignum_miller_rabin(Bignum const* n, Bignum const* base)
+{
+  bn_assert(n);
+  bn_assert(base);
+  bn_assert((n->array[0] & 1) != 0);
+
+  bn__enter(bignum_op_miller_rabin, bignum__get_ndigits(n) + bignum__get_ndigits(base));
+  int prime = bignum__miller_rabin(n, base);
+  bn__exit(bignum_op_miller_rabin);
+  return prime;
+}
+
+int bignum_is_probable_prime(Bignum const* n, int rounds)
+{
+  bn_assert(n);
+  bn_assert(1 <= rounds && rounds <= bn__small_prime_count + 1);
+
+  bn__enter(bignum_op_is_probable_prime, bignum__get_ndigits(n));
+  int prime = bignum__is_probable_prime(n, rounds);
+  bn__exit(bignum_op_is_probable_prime);
+  return prime;
+}
+
+void bignum_next_prime(Bignum* res, Bignum const* a, int rounds)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(1 <= rounds && rounds <= bn__small_prime_count + 1);
+
+  bn__enter(bignum_op_next_prime, bignum__get_ndigits(a));
+  bignum__next_prime(res, a, rounds);
+  bn__exit(bignum_op_next_prime);
+}
+
+int bignum_span_cmp(bn_word const* a, int an, bn_word const* b, int bn)
+{
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(an >= 1 && bn >= 1);
+
+#if defined(bn_constant_time)
+  // Both differences are taken over the longer length, with the shorter
+  // operand extended by zeros.
+  int n = (an > bn)? an : bn;
+  bn_word less = 0;
+  bn_word greater = 0;
+  for(int i = 0; i != n; ++i) {
+    bn_word ai = (i < an)? a[i] : 0;
+    bn_word bi = (i < bn)? b[i] : 0;
+    bn_word d;
+    less = bignum__subb(ai, bi, less, &d);
+    greater = bignum__subb(bi, ai, greater, &d);
+  }
+  return (int)greater - (int)less;
+#else
+  while(an > 1 && a[an-1] == 0) --an;
+  while(bn > 1 && b[bn-1] == 0) --bn;
+  if(an != bn) {
+    return (an > bn)? 1 : -1;
+  }
+  return bignum__cmp_n(a, b, an);
+#endif
+}
+
+// The comparison all the predicates are built on, returns -1, 0 or 1. With
+// bn_track_length different lengths decide it right away, otherwise the
+// words are compared from the top of the array, zeros included, which
+// finds the lengths on the way.
+static int
+bignum__cmp(Bignum const *a, Bignum const *b)
+{
+#if defined(bn_constant_time)
+  return bignum_span_cmp(a->array, bn_array_size, b->array, bn_array_size);
+#elif defined(bn_track_length)
+  if(a->length != b->length) {
+    return (a->length > b->length)? 1 : -1;
+  }
+  return bignum__cmp_n(a->array, b->array, a->length);
+#else
+  return bignum__cmp_n(a->array, b->array, bn_array_size);
+#endif
+}
+
+int bignum_cmp(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+  bn__enter(bignum_op_cmp, bignum__get_ndigits(a) + bignum__get_ndigits(b));
+  int c = bignum__cmp(a, b);
+  bn__exit(bignum_op_cmp);
+  return c;
+}
+
+int bignum_greater(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+#if defined(bn_constant_time)
+  return (int)bignum__less_n(b->array, a->array, bn_array_size);
+#else
+  return bignum__cmp(a, b) > 0;
+#endif
+}
+
+int bignum_less(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+#if defined(bn_constant_time)
+  return (int)bignum__less_n(a->array, b->array, bn_array_size);
+#else
+  return bignum__cmp(a, b) < 0;
+#endif
+}
+
+int bignum_geq(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+#if defined(bn_constant_time)
+  return (int)(bignum__less_n(a->array, b->array, bn_array_size) ^ 1);
+#else
+  return bignum__cmp(a, b) >= 0;
+#endif
+}
+
+int bignum_leq(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+#if defined(bn_constant_time)
+  return (int)(bignum__less_n(b->array, a->array, bn_array_size) ^ 1);
+#else
+  return bignum__cmp(a, b) <= 0;
+#endif
+}
+
+int bignum_equal(Bignum const* a, Bignum const* b)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+#if defined(bn_constant_time)
+  bn_word diff = 0;
+  for(int i = 0; i != bn_array_size; ++i) {
+    diff |= a->array[i] ^ b->array[i];
+  }
+  return (int)(bignum__nonzero(diff) ^ 1);
+#else
+  return bignum__cmp(a, b) == 0;
+#endif
+}
+
+int bignum_is_zero(Bignum const* n)
 {
   bn_assert(n);
-  int carry = 1;
-  for(int i = 0; i != bn_array_size; ++i)
-  {
-    n->array[i] += carry;
+
+#if defined(bn_constant_time)
+  bn_word any = 0;
+  for(int i = 0; i != bn_array_size; ++i) {
+    any |= n->array[i];
+  }
+  return (int)(bignum__nonzero(any) ^ 1);
+#else
+  int i = bignum__used(n);
+  if(i == 0) return 1;
+  do {
+    -- i;
     if(n->array[i] != 0) {
-      carry = 0;
-      break;
+      return 0;
     }
+  } while(i!=0);
+
+  return 1;
+#endif
+}
+
+void bignum_cmov(Bignum* r, Bignum const* a, int cond)
+{
+  bn_assert(r);
+  bn_assert(a);
+
+  bn_word mask = bignum__mask(bignum__nonzero((bn_word)(unsigned)cond));
+  bignum__cselect_n(r->array, a->array, bn_array_size, mask);
+#if defined(bn_track_length)
+  r->length ^= (r->length ^ a->length) & (int)mask;
+#endif
+}
+
+void bignum_cswap(Bignum* a, Bignum* b, int cond)
+{
+  bn_assert(a);
+  bn_assert(b);
+
+  bn_word mask = bignum__mask(bignum__nonzero((bn_word)(unsigned)cond));
+  bignum__cswap_n(a->array, b->array, bn_array_size, mask);
+#if defined(bn_track_length)
+  int t = (a->length ^ b->length) & (int)mask;
+  a->length ^= t;
+  b->length ^= t;
+#endif
+}
+
+
+
+// Montgomery reduction. Takes `t[0..2n)`, where t < m*R, and stores t/R mod m
+// to `r[0..n)`. The contents of t are destroyed.
+static void
+bignum__mont_redc(bn_word *r, bn_word *t, BignumMont const *ctx)
+{
+  int n = ctx->ndigits;
+  bn_word const *m = ctx->modulus.array;
+
+  // Each step makes the lowest remaining word of t zero by adding a
+  // multiple of m, the carries out of the top are kept in `hi`.
+  bn_word hi = 0;
+  for(int i = 0; i != n; ++i) {
+    bn_word u = t[i] * ctx->minv;
+    bn_word c = bignum__addmul_1(t+i, m, n, u);
+    hi = bignum__addc(t[i+n], c, hi, &t[i+n]);
   }
-  bn_overflow_flag |= carry;
+
+  // Here t/R < 2m, so at most one subtraction is needed.
+#if defined(bn_constant_time)
+  // The difference is always computed into r and the result is selected.
+  // Subtracting is needed if hi is set, in which case the difference
+  // borrows out of the n words, or if it doesn't borrow.
+  bn_word borrow = 0;
+  for(int i = 0; i != n; ++i) {
+    borrow = bignum__subb(t[n+i], m[i], borrow, &r[i]);
+  }
+  bignum__cselect_n(r, t+n, n, bignum__mask((hi | (borrow ^ 1)) ^ 1));
+#else
+  if(hi != 0 || bignum__cmp_n(t+n, m, n) >= 0) {
+    bignum__sub_n(t+n, m, n);
+  }
+  for(int i = 0; i != n; ++i) {
+    r[i] = t[n+i];
+  }
+#endif
 }
 
-void bignum_decr(Bignum* n)
+static void
+bignum__mont_mul(bn_word *r, bn_word const *a, bn_word const *b,
+                 BignumMont const *ctx)
 {
-  bn_assert(n);
-  int borrow = 1;
-  for(int i = 0; i != bn_array_size; ++i)
-  {
-    n->array[i] -= borrow;
-    if(n->array[i] != 0xFFFFFFFF) {
-      borrow = 0;
-      break;
+  int n = ctx->ndigits;
+  bn_word t[2*bn_array_size];
+  if(n >= bn_karatsuba_threshold) {
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__mul_karatsuba(t, a, b, n, scratch);
+  }
+  else {
+    bignum__mul_basecase(t, a, n, b, n);
+  }
+  bignum__mont_redc(r, t, ctx);
+}
+
+static void
+bignum__mont_sqr(bn_word *r, bn_word const *a, BignumMont const *ctx)
+{
+  int n = ctx->ndigits;
+  bn_word t[2*bn_array_size];
+  if(n >= bn_karatsuba_threshold) {
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__sqr_karatsuba(t, a, n, scratch);
+  }
+  else {
+    bignum__sqr_basecase(t, a, n);
+  }
+  bignum__mont_redc(r, t, ctx);
+}
+
+void bignum_mont_init(BignumMont* ctx, Bignum const* m)
+{
+  bn_assert(ctx);
+  bn_assert(m);
+  bn_assert(m->array[0] & 1);
+
+  int n = bignum__get_ndigits(m);
+  bn__enter(bignum_op_mont_init, n);
+  bignum_init(&ctx->modulus);
+  bignum_assign(&ctx->modulus, m);
+  ctx->ndigits = n;
+
+  // Newton's iteration for the inverse modulo 2**bn_word_bits, every step
+  // doubles the number of correct low bits, m0 itself is correct to 3 bits.
+  bn_word m0 = m->array[0];
+  bn_word inv = m0;
+  for(int i = 0; i != (bn_word_bits == 32? 4 : 5); ++i) {
+    inv *= 2 - m0*inv;
+  }
+  ctx->minv = (bn_word)0 - inv;
+
+  // R mod m is the two's complement of m in n words, reduced by m. It fits
+  // in n words, even if n is the full width.
+  Bignum x;
+  bignum_init(&x);
+  for(int i = 0; i != n; ++i) {
+    x.array[i] = ~m->array[i];
+  }
+  bignum__set_length(&x, n);
+  bignum_incr_ex(&x);
+  Bignum q;
+  bignum_init(&q);
+  bignum_divmod(&q, &x, &x, m);
+
+  // Doubling R mod m another bn_word_bits*n times gives R**2 mod m.
+  for(int i = 0; i != bn_word_bits*n; ++i) {
+    bn_word bit = 0;
+    for(int j = 0; j != n; ++j) {
+      bn_word w = x.array[j];
+      x.array[j] = (w << 1) | bit;
+      bit = w >> (bn_word_bits-1);
+    }
+    if(bit != 0 || bignum__cmp_n(x.array, m->array, n) >= 0) {
+      bignum__sub_n(x.array, m->array, n);
+    }
+  }
+  bignum_init(&ctx->r2);
+  bignum__store(&ctx->r2, x.array, n);
+  bn__exit(bignum_op_mont_init);
+}
+
+void bignum_to_mont(Bignum* res, Bignum const* a, BignumMont const* ctx)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(ctx);
+  bn__enter(bignum_op_to_mont, bignum__get_ndigits(a));
+
+  Bignum x;
+  bignum_init(&x);
+  // In constant-time mode `a` is always reduced, the comparison would show
+  // if it's less than the modulus.
+#if defined(bn_constant_time)
+  int reduce = 1;
+#else
+  int reduce = (bignum_cmp(a, &ctx->modulus) >= 0);
+#endif
+  if(reduce) {
+    Bignum q;
+    bignum_init(&q);
+    bignum_divmod(&q, &x, a, &ctx->modulus);
+  }
+  else {
+    bignum_assign(&x, a);
+  }
+  bignum__mont_mul(x.array, x.array, ctx->r2.array, ctx);
+  bignum__store(res, x.array, ctx->ndigits);
+  bn__exit(bignum_op_to_mont);
+}
+
+void bignum_from_mont(Bignum* res, Bignum const* a, BignumMont const* ctx)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(ctx);
+
+  int n = ctx->ndigits;
+  bn__enter(bignum_op_from_mont, n);
+  bn_word t[2*bn_array_size];
+  for(int i = 0; i != n; ++i) {
+    t[i] = a->array[i];
+    t[n+i] = 0;
+  }
+  bn_word x[bn_array_size];
+  bignum__mont_redc(x, t, ctx);
+  bignum__store(res, x, n);
+  bn__exit(bignum_op_from_mont);
+}
+
+void bignum_mont_mul(Bignum* res, Bignum const* a, Bignum const* b, BignumMont const* ctx)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(ctx);
+
+  bn__enter(bignum_op_mont_mul, 2*ctx->ndigits);
+  bn_word x[bn_array_size];
+  bignum__mont_mul(x, a->array, b->array, ctx);
+  bignum__store(res, x, ctx->ndigits);
+  bn__exit(bignum_op_mont_mul);
+}
+
+void bignum_mont_sqr(Bignum* res, Bignum const* a, BignumMont const* ctx)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(ctx);
+
+  bn__enter(bignum_op_mont_sqr, ctx->ndigits);
+  bn_word x[bn_array_size];
+  bignum__mont_sqr(x, a->array, ctx);
+  bignum__store(res, x, ctx->ndigits);
+  bn__exit(bignum_op_mont_sqr);
+}
+
+static inline int
+bignum__test_bit(Bignum const *n, int bit)
+{
+  return (n->array[bit/bn_word_bits] >> (bit%bn_word_bits)) & 1;
+}
+
+void bignum_modexp(Bignum* res, Bignum const* base, Bignum const* exp, BignumMont const* ctx)
+{
+  bn_assert(res);
+  bn_assert(base);
+  bn_assert(exp);
+  bn_assert(ctx);
+
+  int n = ctx->ndigits;
+  bn__enter(bignum_op_modexp, n + bignum__get_ndigits(exp));
+  Bignum acc;
+  bignum_init(&acc);
+
+#if defined(bn_constant_time)
+  // Montgomery ladder. With k being the part of the exponent scanned so
+  // far, r0 = base**k and r1 = base**(k+1). A zero bit makes them r0**2
+  // and r0*r1, a one bit r0*r1 and r1**2, so both cases are done with the
+  // same  multiplication and squaring, and the operands are swapped with a
+  // mask before and after them. The whole array of the exponent is scanned,
+  // which hides the length of it too.
+  bn_word r0[bn_array_size];
+  bn_word r1[bn_array_size];
+  Bignum x;
+  bignum_init(&x);
+  bignum_from_u64(&x, 1);
+  bignum_to_mont(&x, &x, ctx);
+  for(int i = 0; i != n; ++i) r0[i] = x.array[i];
+  bignum_to_mont(&x, base, ctx);
+  for(int i = 0; i != n; ++i) r1[i] = x.array[i];
+
+  bn_word swap = 0;
+  for(int i = bn_word_bits*bn_array_size; i-- != 0; ) {
+    bn_word bit = (exp->array[i/bn_word_bits] >> (i%bn_word_bits)) & 1;
+    bignum__cswap_n(r0, r1, n, bignum__mask(bit ^ swap));
+    swap = bit;
+    bignum__mont_mul(r1, r0, r1, ctx);
+    bignum__mont_sqr(r0, r0, ctx);
+  }
+  bignum__cswap_n(r0, r1, n, bignum__mask(swap));
+
+  bignum__store(&acc, r0, n);
+  bignum_from_mont(res, &acc, ctx);
+#else
+  int edigits = bignum__get_ndigits(exp);
+  if(exp->array[edigits-1] == 0) {
+    // x**0 = 1, which is reduced, in case the modulus is 1.
+    bignum_from_u64(&acc, (n == 1 && ctx->modulus.array[0] == 1)? 0 : 1);
+    bignum_assign(res, &acc);
+    bn__exit(bignum_op_modexp);
+    return;
+  }
+  int nbits = bn_word_bits*edigits - bignum__clz(exp->array[edigits-1]);
+
+  int window = 1;
+  if(nbits > 671) window = 6;
+  else if(nbits > 239) window = 5;
+  else if(nbits > 79) window = 4;
+  else if(nbits > 23) window = 3;
+  else if(nbits > 7) window = 2;
+  if(window > bn_modexp_max_window) window = bn_modexp_max_window;
+
+  // Table of odd powers base**1, base**3, ..., base**(2**window - 1), in
+  // Montgomery form, n words each.
+  bn_word table[(1 << (bn_modexp_max_window-1))*bn_array_size];
+  Bignum b;
+  bignum_init(&b);
+  bignum_to_mont(&b, base, ctx);
+  for(int i = 0; i != n; ++i) {
+    table[i] = b.array[i];
+  }
+  if(window > 1) {
+    bn_word b2[bn_array_size];
+    bignum__mont_sqr(b2, b.array, ctx);
+    for(int k = 1; k != (1 << (window-1)); ++k) {
+      bignum__mont_mul(table + k*n, table + (k-1)*n, b2, ctx);
+    }
+  }
+
+  // Scan the exponent from the top bit. A run of zeros costs a squaring per
+  // bit, otherwise the longest window of at most `window` bits that ends
+  // with a one is multiplied in at once. The top bit is always set, so the
+  // first window just loads the accumulator.
+  int first = 1;
+  int i = nbits - 1;
+  while(i >= 0) {
+    if(!bignum__test_bit(exp, i)) {
+      bignum__mont_sqr(acc.array, acc.array, ctx);
+      i -= 1;
+      continue;
+    }
+    int j = i - window + 1;
+    if(j < 0) j = 0;
+    while(!bignum__test_bit(exp, j)) ++j;
+
+    int value = 0;
+    for(int k = i; k >= j; --k) {
+      value = 2*value + bignum__test_bit(exp, k);
+    }
+    bn_word const *power = table + (value >> 1)*n;
+    if(first) {
+      for(int k = 0; k != n; ++k) acc.array[k] = power[k];
+      first = 0;
+    }
+    else {
+      for(int k = i; k >= j; --k) {
+        bignum__mont_sqr(acc.array, acc.array, ctx);
+      }
+      bignum__mont_mul(acc.array, acc.array, power, ctx);
+    }
+    i = j - 1;
+  }
+
+  bignum__set_length(&acc, n);
+  bignum_from_mont(res, &acc, ctx);
+#endif
+  bn__exit(bignum_op_modexp);
+}
+
+// Returns the `w` bits of `n` starting at `bit`, where w < bn_word_bits.
+static inline bn_word
+bignum__get_window(Bignum const *n, int bit, int w)
+{
+  int i = bit / bn_word_bits;
+  int s = bit % bn_word_bits;
+  bn_word v = n->array[i] >> s;
+  if(s + w > bn_word_bits && i+1 != bn_array_size) {
+    v |= n->array[i+1] << (bn_word_bits - s);
+  }
+  return v & (((bn_word)1 << w) - 1);
+}
+
+size_t bignum_fixed_base_words(BignumMont const* ctx, int ebits, int window)
+{
+  bn_assert(ctx);
+  bn_assert(1 <= ebits && ebits <= bn_word_bits*bn_array_size);
+  bn_assert(1 <= window && window <= 8);
+
+  size_t windows = (size_t)((ebits + window-1) / window);
+  return windows * (((size_t)1 << window) - 1) * (size_t)ctx->ndigits;
+}
+
+void bignum_fixed_base_init(BignumFixedBase* fb, Bignum const* base, int ebits, int window,
+                            BignumMont const* ctx, bn_word* table)
+{
+  bn_assert(fb);
+  bn_assert(base);
+  bn_assert(ctx);
+  bn_assert(table);
+  bn_assert(1 <= ebits && ebits <= bn_word_bits*bn_array_size);
+  bn_assert(1 <= window && window <= 8);
+
+  bn__enter(bignum_op_fixed_base_init, bignum__get_ndigits(base));
+  int n = ctx->ndigits;
+  int windows = (ebits + window-1) / window;
+  int row = (1 << window) - 1;
+
+  // Row k holds x, x**2, ..., x**row for x = base**(2**(k*window)), in
+  // Montgomery form. The x of the next row is the last entry times x.
+  Bignum x;
+  bignum_init(&x);
+  bignum_to_mont(&x, base, ctx);
+  bn_word *entry = table;
+  for(int k = 0; k != windows; ++k) {
+    for(int i = 0; i != n; ++i) {
+      entry[i] = x.array[i];
+    }
+    for(int d = 1; d != row; ++d) {
+      bignum__mont_mul(entry + n, entry, x.array, ctx);
+      entry += n;
+    }
+    if(k+1 != windows) {
+      bignum__mont_mul(x.array, entry, x.array, ctx);
+    }
+    entry += n;
+  }
+
+  fb->ctx = ctx;
+  fb->table = table;
+  fb->ebits = ebits;
+  fb->window = window;
+  bn__exit(bignum_op_fixed_base_init);
+}
+
+void bignum_fixed_base_exp(Bignum* res, Bignum const* exp, BignumFixedBase const* fb)
+{
+  bn_assert(res);
+  bn_assert(exp);
+  bn_assert(fb);
+#if !defined(bn_constant_time)
+  bn_assert(bignum_bit_length(exp) <= fb->ebits);
+#endif
+
+  BignumMont const *ctx = fb->ctx;
+  int n = ctx->ndigits;
+  int w = fb->window;
+  int windows = (fb->ebits + w-1) / w;
+  int row = (1 << w) - 1;
+  bn__enter(bignum_op_fixed_base_exp, bignum__get_ndigits(exp));
+
+  Bignum acc;
+  bignum_init(&acc);
+  bignum_from_u64(&acc, 1);
+  bignum_to_mont(&acc, &acc, ctx);
+
+#if defined(bn_constant_time)
+  // A zero digit selects the Montgomery form of 1, so that every window
+  // does the same multiplication.
+  bn_word one[bn_array_size];
+  bn_word sel[bn_array_size];
+  for(int i = 0; i != n; ++i) {
+    one[i] = acc.array[i];
+  }
+  for(int k = 0; k != windows; ++k) {
+    bn_word d = bignum__get_window(exp, k*w, w);
+    bn_word const *entry = fb->table + (size_t)k*(size_t)row*(size_t)n;
+    bn_word mask = bignum__mask(bignum__nonzero(d) ^ 1);
+    for(int i = 0; i != n; ++i) {
+      sel[i] = one[i] & mask;
+    }
+    for(int j = 1; j <= row; ++j) {
+      mask = bignum__mask(bignum__nonzero(d ^ (bn_word)j) ^ 1);
+      for(int i = 0; i != n; ++i) {
+        sel[i] |= entry[i] & mask;
+      }
+      entry += n;
+    }
+    bignum__mont_mul(acc.array, acc.array, sel, ctx);
+  }
+#else
+  int first = 1;
+  for(int k = 0; k != windows; ++k) {
+    bn_word d = bignum__get_window(exp, k*w, w);
+    if(d == 0) continue;
+    bn_word const *entry = fb->table + ((size_t)k*(size_t)row + (size_t)(d-1))*(size_t)n;
+    if(first) {
+      for(int i = 0; i != n; ++i) {
+        acc.array[i] = entry[i];
+      }
+      first = 0;
+    }
+    else {
+      bignum__mont_mul(acc.array, acc.array, entry, ctx);
+    }
+  }
+#endif
+
+  bignum__set_length(&acc, n);
+  bignum_from_mont(res, &acc, ctx);
+  bn__exit(bignum_op_fixed_base_exp);
+}
+
+void bignum_barrett_init(BignumBarrett* ctx, Bignum const* m)
+{
+  bn_assert(ctx);
+  bn_assert(m);
+  bn_assert(!bignum_is_zero(m));
+
+  int k = bignum__get_ndigits(m);
+  bn__enter(bignum_op_barrett_init, k);
+  bignum_init(&ctx->modulus);
+  bignum_assign(&ctx->modulus, m);
+  ctx->ndigits = k;
+
+  // B**2k is 2k+1 words long, mu has at most k+2 of them, the top one is
+  // only set if m is a power of B.
+  bn_word u[2*bn_array_size+1];
+  for(int i = 0; i != 2*k; ++i) {
+    u[i] = 0;
+  }
+  u[2*k] = 1;
+  bn_word r[bn_array_size];
+  int mn = k+2;
+  if(k == 1) {
+    bignum__divmod_1(ctx->mu, u, 2*k+1, m->array[0]);
+    mn = 2*k+1;
+  }
+  else {
+    bignum__divmod_knuth(ctx->mu, r, u, 2*k+1, m->array, k);
+  }
+  while(ctx->mu[mn-1] == 0) --mn;
+  ctx->mudigits = mn;
+  bn__exit(bignum_op_barrett_init);
+}
+
+// Reduces `x[0..xn)`, where xn <= 2k, and stores the result to r[0..k).
+// As in HAC 14.42: q = floor(floor(x/B**(k-1))*mu/B**(k+1)) is at most two
+// less than floor(x/m), so x - q*m, which is computed modulo B**(k+1), needs
+// at most two more subtractions of m. Only the needed halves of the two
+// products are computed (HAC 14.44), the first one without the words that
+// can't reach past word k. That makes q at most one smaller still, but
+// takes about as many word multiplications as one full product.
+static void
+bignum__barrett_reduce(bn_word *r, bn_word const *x, int xn,
+                       BignumBarrett const *ctx)
+{
+  int k = ctx->ndigits;
+  bn_word const *m = ctx->modulus.array;
+  bn_assert(xn <= 2*k);
+
+  bn_word t[2*bn_array_size+4];
+  bn_word rem[bn_array_size+1];
+  for(int i = 0; i != k+1; ++i) {
+    rem[i] = (i < xn)? x[i] : 0;
+  }
+
+  if(xn >= k) {
+    bn_word const *q1 = x + (k-1);
+    int qn = xn - (k-1);
+    bn_word const *mu = ctx->mu;
+    int mn = ctx->mudigits;
+    int q3n = qn + mn - (k+1);
+    if(q3n > 0) {
+      bn_word q3[bn_array_size+2];
+      for(int i = 0; i != qn+mn; ++i) {
+        t[i] = 0;
+      }
+      for(int i = 0; i != qn; ++i) {
+        int j = (i < k-1)? k-1-i : 0;
+        if(j < mn) {
+          t[i+mn] = bignum__addmul_1(t+i+j, mu+j, mn-j, q1[i]);
+        }
+      }
+      for(int i = 0; i != q3n; ++i) {
+        q3[i] = t[k+1+i];
+      }
+
+      // The low k+1 words of q3*m.
+      for(int i = 0; i != k+1; ++i) {
+        t[i] = 0;
+      }
+      for(int i = 0; i != q3n && i != k+1; ++i) {
+        int len = (i == 0)? k : k+1-i;
+        bn_word c = bignum__addmul_1(t+i, m, len, q3[i]);
+        if(i+len != k+1) t[i+len] += c;
+      }
+      bignum__sub_n(rem, t, k+1);
     }
+    // The difference fits k+1 words, the borrows out of them cancel.
+    while(rem[k] != 0 || bignum__cmp_n(rem, m, k) >= 0) {
+      rem[k] -= bignum__sub_n(rem, m, k);
+    }
+  }
+  for(int i = 0; i != k; ++i) {
+    r[i] = rem[i];
+  }
+}
+
+// Reduces `x[0..xn)` of any length, destroying it. The top 2k words are
+// reduced to k words until the rest fits one pass.
+static void
+bignum__barrett_reduce_long(bn_word *r, bn_word *x, int xn,
+                            BignumBarrett const *ctx)
+{
+  int k = ctx->ndigits;
+  while(xn > 2*k) {
+    bn_word *top = x + xn - 2*k;
+    bignum__barrett_reduce(top, top, 2*k, ctx);
+    xn -= k;
+    while(xn > 1 && x[xn-1] == 0) --xn;
+  }
+  bignum__barrett_reduce(r, x, xn, ctx);
+}
+
+void bignum_barrett_reduce(Bignum* res, Bignum const* a, BignumBarrett const* ctx)
+{
+  bn_assert(res);
+  bn_assert(a);
+  bn_assert(ctx);
+
+  bn_word x[bn_array_size];
+  int xn = bignum__get_ndigits(a);
+  for(int i = 0; i != xn; ++i) {
+    x[i] = a->array[i];
+  }
+  bn__enter(bignum_op_barrett_reduce, xn);
+  bn_word r[bn_array_size];
+  bignum__barrett_reduce_long(r, x, xn, ctx);
+  bignum__store(res, r, ctx->ndigits);
+  bn__exit(bignum_op_barrett_reduce);
+}
+
+static void
+bignum__barrett_mulmod(bn_word *r, bn_word const *a, bn_word const *b,
+                       BignumBarrett const *ctx)
+{
+  int k = ctx->ndigits;
+  bn_word t[2*bn_array_size];
+  if(k >= bn_karatsuba_threshold) {
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__mul_karatsuba(t, a, b, k, scratch);
+  }
+  else {
+    bignum__mul_basecase(t, a, k, b, k);
   }
-  bn_overflow_flag |= borrow;
+  bignum__barrett_reduce_long(r, t, 2*k, ctx);
 }
 
-void bignum_add(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+void bignum_barrett_mulmod(Bignum* res, Bignum const* a, Bignum const* b, BignumBarrett const* ctx)
 {
   bn_assert(res);
-  bn_assert(lhs);
-  bn_assert(rhs);
-
-  uint64_t tmp;
-  uint64_t carry = 0;
-  int i;
-  for (i = 0; i < bn_array_size; ++i)
-  {
-    tmp = (uint64_t)lhs->array[i] + (uint64_t)rhs->array[i] + carry;
-    res->array[i] = (uint32_t)(tmp & 0xFFFFFFFF);
-    carry = tmp >> 32;
-  }
+  bn_assert(a);
+  bn_assert(b);
+  bn_assert(ctx);
 
-  bn_overflow_flag |= (carry!=0);
+  bn__enter(bignum_op_barrett_mulmod, 2*ctx->ndigits);
+  bn_word x[bn_array_size];
+  bignum__barrett_mulmod(x, a->array, b->array, ctx);
+  bignum__store(res, x, ctx->ndigits);
+  bn__exit(bignum_op_barrett_mulmod);
 }
 
+// Decimal conversion works in chunks of bn__dec_digits digits, the largest
+// power of ten that fits a word. Values longer than bn__dec_threshold words
+// are split in halves around a power base**(2**k), and the halves are
+// converted recursively. The powers are computed once per call by repeated
+// squaring, so the splits use the Karatsuba multiplication. Parsing one
+// chunk at a time is a cheap single pass per chunk, so the split only pays
+// off for strings of more than bn__dec_parse_threshold chunks.
+#if bn_word_bits == 32
+  #define bn__dec_base   UINT32_C(1000000000)
+  #define bn__dec_digits 9
+#else
+  #define bn__dec_base   UINT64_C(10000000000000000000)
+  #define bn__dec_digits 19
+#endif
+#define bn__dec_threshold 16
+#define bn__dec_parse_threshold 256
+#define bn__dec_levels 24
+// Upper bound on the number of decimal digits in a Bignum.
+#define bn__dec_max_digits ((bn_word_bits*bn_array_size)/3 + 1)
+// Words a product of two values with `len` digits in total can take before
+// it's trimmed, log2(10) < 10/3.
+#define bn__dec_words(len) ((len)*10/(3*bn_word_bits) + 3)
+
+struct bn__dec_powers {
+  bn_word *p[bn__dec_levels];
+  int n[bn__dec_levels];
+  int levels;
+  bn_word words[3*bn_array_size + 4*bn__dec_levels];
+};
 
-void bignum_sub(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+// Fills `pw` with base**(2**k) for as long as the powers have fewer than
+// `ndigits` digits and at most `maxwords` words.
+static void
+bignum__dec_powers(struct bn__dec_powers *pw, int ndigits, int maxwords,
+                   bn_word *scratch)
 {
-  bn_assert(res);
-  bn_assert(lhs);
-  bn_assert(rhs);
-
-  int borrow = 0;
-  for (int i = 0; i < bn_array_size; ++i) {
-    int old_borrow=borrow;
-    borrow = (rhs->array[i] > lhs->array[i]) ? 1 : 0;
-    res->array[i] = lhs->array[i] - rhs->array[i] - old_borrow;
+  int const size = (int)(sizeof(pw->words)/sizeof(pw->words[0]));
+  pw->words[0] = bn__dec_base;
+  pw->p[0] = pw->words;
+  pw->n[0] = 1;
+  pw->levels = 1;
+  while(pw->levels != bn__dec_levels
+     && (bn__dec_digits << pw->levels) < ndigits) {
+    int k = pw->levels;
+    bn_word *a = pw->p[k-1];
+    int an = pw->n[k-1];
+    bn_word *r = a + an;
+    if((int)(r - pw->words) + 2*an > size || 2*an-1 > maxwords) break;
+    if(an >= bn_karatsuba_threshold) {
+      bignum__sqr_karatsuba(r, a, an, scratch);
+    }
+    else {
+      bignum__sqr_basecase(r, a, an);
+    }
+    int rn = 2*an;
+    while(r[rn-1] == 0) rn--;
+    if(rn > maxwords) break;
+    pw->p[k] = r;
+    pw->n[k] = rn;
+    pw->levels += 1;
   }
-
-  bn_overflow_flag |= (borrow!=0);
 }
 
-
-void bignum_mul(Bignum* res, Bignum const* lhs, Bignum const* rhs)
+// Computes the full product of `a[0..an)` and `b[0..bn)` into r[0..an+bn).
+static void
+bignum__mul_words(bn_word *r, bn_word const *a, int an,
+                  bn_word const *b, int bn, bn_word *tmp, bn_word *scratch)
 {
-  bn_assert(res);
-  bn_assert(lhs);
-  bn_assert(rhs);
-
-  Bignum sum;
-  bignum_init(&sum);
+  if(an < bn) {
+    bn_word const *t = a; a = b; b = t;
+    int tn = an; an = bn; bn = tn;
+  }
+  if(bn >= bn_karatsuba_threshold) {
+    bignum__mul_unbalanced(r, a, an, b, bn, tmp, scratch);
+  }
+  else {
+    bignum__mul_basecase(r, a, an, b, bn);
+  }
+}
 
-  uint64_t carry =0;
 
-  for(int i = 0; i < bn_array_size; ++i)
-  {
-    Bignum row;
-    bignum_init(&row);
+// Checks `str[0..len)` for non-decimal characters. Only used in assertions,
+// so it's skipped when bn_assert is disabled.
+static inline int
+bignum__dec_is_valid(char const *str, int len)
+{
+  for(int i = 0; i != len; ++i) {
+    if(str[i] < '0' || '9' < str[i]) return 0;
+  }
+  return 1;
+}
 
-    carry = 0;
-    for (int j = 0; j < bn_array_size - i; ++j)
-    {
-      uint64_t ld = (uint64_t)lhs->array[j];
-      uint64_t rd = (uint64_t)rhs->array[i];
-      uint64_t tmp = carry + ld * rd;
-      row.array[i+j] += (uint32_t)(tmp & 0xFFFFFFFF);
-      carry = tmp >> 32;
+// Parses `str[0..len)` into `r` one chunk at a time and returns the number
+// of words. Words past `cap` are dropped and `overflow` is set instead.
+static int
+bignum__from_dec_basecase(bn_word *r, char const *str, int len, int cap,
+                          uint32_t *overflow)
+{
+  int used = 0;
+  int i = 0;
+  while(i != len) {
+    // Only the first chunk can be short.
+    int k = (len - i) % bn__dec_digits;
+    if(k == 0) k = bn__dec_digits;
+    bn_word chunk = 0;
+    bn_word scale = 1;
+    for(; k != 0; --k) {
+      chunk = 10*chunk + (bn_word)(str[i++] - '0');
+      scale *= 10;
+    }
+    bn_word carry = bignum__mul_1(r, r, used, scale, chunk);
+    if(carry != 0) {
+      if(used != cap) r[used++] = carry;
+      else *overflow = 1;
     }
+  }
+  return used;
+}
 
-    bignum_add(&sum, &sum, &row);
-    bn_overflow_flag |= (carry != 0);
+// Parses `str[0..len)` into `r`, which must have room for
+// bn__dec_words(len) words, and returns the number of words. The halves are
+// built in `work`.
+static int
+bignum__from_dec_rec(bn_word *r, char const *str, int len,
+                     struct bn__dec_powers const *pw, bn_word *work,
+                     bn_word *tmp, bn_word *scratch)
+{
+  if(len <= bn__dec_digits*bn__dec_threshold) {
+    uint32_t overflow = 0;
+    return bignum__from_dec_basecase(r, str, len, bn__dec_words(len),
+                                     &overflow);
+  }
+  // The low part gets the largest power that is shorter than the string.
+  int k = pw->levels-1;
+  while(k != 0 && (bn__dec_digits << k) >= len) --k;
+  int lolen = bn__dec_digits << k;
+
+  bn_word *hi = work;
+  bn_word *lo = hi + bn__dec_words(len - lolen);
+  bn_word *next = lo + bn__dec_words(lolen);
+  int hn = bignum__from_dec_rec(hi, str, len - lolen, pw, next, tmp, scratch);
+  int ln = bignum__from_dec_rec(lo, str + len - lolen, lolen, pw, next,
+                                tmp, scratch);
+  if(hn == 0) {
+    for(int i = 0; i != ln; ++i) r[i] = lo[i];
+    return ln;
   }
 
-  bignum_assign(res, &sum);
+  // lo < base**(2**k), so it has at most as many words as the power.
+  int rn = hn + pw->n[k];
+  bignum__mul_words(r, hi, hn, pw->p[k], pw->n[k], tmp, scratch);
+  r[rn] = bignum__add_into(r, rn, lo, ln);
+  rn += 1;
+  while(rn != 0 && r[rn-1] == 0) rn--;
+  return rn;
 }
 
-static int
-bignum__get_ndigits(Bignum const *b)
+// Writes `x[0..xn)` as exactly `ndigits` digits to `out`, padded with
+// zeros. `x` must be less than 10**ndigits, its contents are destroyed.
+static void
+bignum__to_dec_basecase(char *out, int ndigits, bn_word *x, int xn)
 {
-  int ndigits = bn_array_size;
-  do {
-    if(b->array[ndigits-1] != 0) {
-      break;
+  int d = ndigits;
+  while(d != 0) {
+    bn_word chunk = 0;
+    if(xn != 0) {
+      chunk = bignum__divmod_1(x, x, xn, bn__dec_base);
+      while(xn != 0 && x[xn-1] == 0) xn--;
     }
-    ndigits --;
-  } while(ndigits != 1);
-  return ndigits;
+    for(int k = 0; k != bn__dec_digits && d != 0; ++k) {
+      out[--d] = (char)('0' + chunk%10);
+      chunk /= 10;
+    }
+  }
 }
 
-static uint32_t
-bignum_divmod__getdigit(Bignum *r, Bignum const *lhs, Bignum const *rhs)
+// Same as bignum__to_dec_basecase, the quotient and remainder of the splits
+// are stored in `work`.
+static void
+bignum__to_dec_rec(char *out, int ndigits, bn_word *x, int xn,
+                   struct bn__dec_powers const *pw, bn_word *work)
 {
-  bn_assert(r);
-  bn_assert(lhs);
-  bn_assert(rhs);
+  while(xn != 0 && x[xn-1] == 0) xn--;
+  int k = pw->levels-1;
+  while(k != 0 && (bn__dec_digits << k) >= ndigits) --k;
+  int lolen = bn__dec_digits << k;
+  if(lolen >= ndigits || xn <= bn__dec_threshold) {
+    bignum__to_dec_basecase(out, ndigits, x, xn);
+    return;
+  }
 
-  int ldigits = bignum__get_ndigits(lhs);
-  int rdigits = bignum__get_ndigits(rhs);
+  bn_word const *p = pw->p[k];
+  int pn = pw->n[k];
+  if(xn < pn || (xn == pn && bignum__cmp_n(x, p, pn) < 0)) {
+    for(int i = 0; i != ndigits - lolen; ++i) out[i] = '0';
+    bignum__to_dec_rec(out + ndigits - lolen, lolen, x, xn, pw, work);
+    return;
+  }
+
+  bn_word *q = work;
+  int qn = xn - pn + 1;
+  bn_word *rem = q + qn;
+  if(pn == 1) {
+    rem[0] = bignum__divmod_1(q, x, xn, p[0]);
+  }
+  else {
+    bignum__divmod_knuth(q, rem, x, xn, p, pn);
+  }
+  bn_word *next = rem + pn;
+  bignum__to_dec_rec(out, ndigits - lolen, q, qn, pw, next);
+  bignum__to_dec_rec(out + ndigits - lolen, lolen, rem, pn, pw, next);
+}
 
-  if(ldigits == 1 && rdigits == 1) {
-    uint32_t left = lhs->array[0];
-    uint32_t right = rhs->array[0];
+void bignum_from_dec(Bignum* n, char const* str, int maxsize)
+{
+  if(maxsize == 0) return;
 
-    uint32_t q0 = left / right;
-    uint32_t r0 = left % right;
+  bn_assert(n);
+  bn_assert(str);
+  bn_assert(maxsize > 0);
+  bignum_init(n);
 
-    bignum_from_u64(r, r0);
-    return q0;
+  int len = maxsize;
+  for(int i = 0; i != maxsize; ++i) {
+    if(str[i] == 0) {
+      len = i;
+      break;
+    }
+  }
+  bn_assert(bignum__dec_is_valid(str, len));
+  while(len != 0 && str[0] == '0') {
+    str++;
+    len--;
+  }
+  bn__enter(bignum_op_from_dec, (len + bn__dec_digits-1)/bn__dec_digits);
+
+  uint32_t overflow = 0;
+  if(len > bn__dec_max_digits || len <= bn__dec_digits*bn__dec_parse_threshold) {
+    // 10**bits is divisible by 2**bits, so only the last `bits` digits
+    // affect the truncated value, any digit before them overflows.
+    int bits = bn_word_bits*bn_array_size;
+    if(len > bits) {
+      overflow = 1;
+      str += len - bits;
+      len = bits;
+    }
+    int used = bignum__from_dec_basecase(n->array, str, len, bn_array_size,
+                                         &overflow);
+    bignum__set_length(n, used);
   }
   else {
-    Bignum divident;
-    bignum_assign(&divident, lhs);
-
-    uint32_t quotient = 0;
-    while(bignum_cmp(&divident, rhs) >= 0) {
-      bignum_sub(&divident, &divident, rhs);
-      quotient += 1;
+    struct bn__dec_powers pw;
+    bn_word tmp[2*bn_array_size];
+    bn_word scratch[bn__karatsuba_scratch];
+    bn_word work[3*bn__dec_words(bn__dec_max_digits) + 8*bn__dec_levels];
+    bn_word r[bn__dec_words(bn__dec_max_digits)];
+    bignum__dec_powers(&pw, len, bn__dec_words(len), scratch);
+    int rn = bignum__from_dec_rec(r, str, len, &pw, work, tmp, scratch);
+    for(int i = bn_array_size; i < rn; ++i) {
+      overflow |= (r[i] != 0);
     }
+    bignum__store(n, r, (rn < bn_array_size)? rn : bn_array_size);
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
+  bn__exit(bignum_op_from_dec);
+}
+
+int dec_from_bignum(Bignum const* n, char* str, int maxsize)
+{
+  bn_assert(n);
+  bn_assert(str);
+  bn_assert(maxsize > 0);
+
+  char digits[bn__dec_max_digits];
+  bn_word x[bn_array_size];
+  int xn = bignum__get_ndigits(n);
+  bn__enter(bignum_op_to_dec, xn);
+  for(int i = 0; i != xn; ++i) {
+    x[i] = n->array[i];
+  }
+  if(xn > bn__dec_threshold) {
+    struct bn__dec_powers pw;
+    bn_word scratch[bn__karatsuba_scratch];
+    bn_word work[3*bn_array_size + 4*bn__dec_levels];
+    bignum__dec_powers(&pw, bn__dec_max_digits, bn_array_size, scratch);
+    bignum__to_dec_rec(digits, bn__dec_max_digits, x, xn, &pw, work);
+  }
+  else {
+    bignum__to_dec_basecase(digits, bn__dec_max_digits, x, xn);
+  }
 
-    bignum_assign(r, &divident);
-    return quotient;
+  int first = 0;
+  while(first != bn__dec_max_digits-1 && digits[first] == '0') {
+    first++;
   }
+  int len = bn__dec_max_digits - first;
+  int count = (len < maxsize-1)? len : maxsize-1;
+  for(int i = 0; i != count; ++i) {
+    str[i] = digits[first+i];
+  }
+  str[count] = 0;
+  bn__exit(bignum_op_to_dec);
+  return len;
 }
 
-static void
-bignum__append_digit(Bignum *res, Bignum const *num, uint32_t digit)
+void bignum_add_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count)
 {
-  uint64_t i = bn_array_size;
-  if(i != 1) do {
-    i --;
-    res->array[i] = num->array[i-1];
-  } while(i != 1);
-  res->array[0] = digit;
+  uint32_t overflow = 0;
+  for(size_t i = 0; i != count; ++i) {
+    overflow |= bignum_add_ex(out+i, a+i, b+i);
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
 }
 
-void
-bignum_divmod(Bignum* quot, Bignum *rem, Bignum const* lhs, Bignum const* rhs)
+void bignum_sub_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count)
 {
-  bn_assert(lhs);
-  bn_assert(rhs);
-  bn_assert(quot);
-  bn_assert(rem);
+  uint32_t overflow = 0;
+  for(size_t i = 0; i != count; ++i) {
+    overflow |= bignum_sub_ex(out+i, a+i, b+i);
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
+}
 
-  if(bignum_is_zero(rhs)) {
-    bn_assert(0);
-    return;
+void bignum_mul_n(Bignum* out, Bignum const* a, Bignum const* b, size_t count)
+{
+  uint32_t overflow = 0;
+  for(size_t i = 0; i != count; ++i) {
+    overflow |= bignum_mul_ex(out+i, a+i, b+i);
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
   }
+}
 
-  if(bignum_cmp(lhs, rhs) == -1) {
-    // Note(bumbread/2021-10-21): this may be wrong, when the pointers
-    // are aliased. Assignment to rem from lhs may overwrite rhs,
-    // leaving the rest of procedure wrong.
-    // Note(bumbread/2021-10-25): the comment above may be wrong,
-    // too lazy to support it.
-    bignum_assign(rem, lhs);
-    //bignum_sub(rem, rhs, lhs);
-    bignum_from_u64(quot, 0);
-    return;
+void bignum_cmp_n(int* out, Bignum const* a, Bignum const* b, size_t count)
+{
+  for(size_t i = 0; i != count; ++i) {
+    out[i] = bignum_cmp(a+i, b+i);
   }
+}
 
-  Bignum divident;
-  Bignum quotient = {0};
-  Bignum remainder = {0};
+// Number of values the SoA kernels process together. The inner loops run
+// over one block, with a carry per value.
+#define bn__soa_block 16
 
-  int ldigits = bignum__get_ndigits(lhs);
-  int rdigits = bignum__get_ndigits(rhs);
-  
-  {
-    // Initialise remainder to be `rdigits-1` digits of the
-    // lhs number.
-    int i = rdigits - 1;
-    if(i != 0) do {
-      i --;
-      remainder.array[i] = lhs->array[i+1];
-    } while(i != 0);
+void bignum_to_soa(bn_word* soa, Bignum const* src, size_t count)
+{
+  bn_assert(soa || count == 0);
+  bn_assert(src || count == 0);
+  for(size_t j = 0; j != count; ++j) {
+    for(int i = 0; i != bn_array_size; ++i) {
+      soa[(size_t)i*count + j] = src[j].array[i];
+    }
   }
+}
 
-  int di = ldigits-rdigits;
-  for(int i = 0; i <= ldigits-rdigits; ++i) {
-    bignum__append_digit(&divident, &remainder, lhs->array[di--]);
-    uint32_t digit = bignum_divmod__getdigit(&remainder, &divident, rhs);
-    bignum__append_digit(&quotient, &quotient, digit);
+void bignum_from_soa(Bignum* dst, bn_word const* soa, size_t count)
+{
+  bn_assert(dst || count == 0);
+  bn_assert(soa || count == 0);
+  for(size_t j = 0; j != count; ++j) {
+    for(int i = 0; i != bn_array_size; ++i) {
+      dst[j].array[i] = soa[(size_t)i*count + j];
+    }
+    bignum__set_length(&dst[j], bn_array_size);
   }
-
-  bignum_assign(quot, &quotient);
-  bignum_assign(rem, &remainder);
 }
 
-int bignum_cmp(Bignum const* a, Bignum const* b)
+void bignum_soa_add(bn_word* r, bn_word const* a, bn_word const* b, size_t count)
 {
-  bn_assert(a);
-  bn_assert(b);
-
-  int i = bn_array_size;
-  do
-  {
-    i -= 1;
-    if (a->array[i] > b->array[i])
-    {
-      return 1;
+  bn_word overflow = 0;
+  for(size_t j0 = 0; j0 < count; j0 += bn__soa_block) {
+    size_t m = (count - j0 < bn__soa_block)? count - j0 : bn__soa_block;
+    bn_word carry[bn__soa_block];
+    for(size_t j = 0; j != m; ++j) {
+      carry[j] = 0;
+    }
+    for(int i = 0; i != bn_array_size; ++i) {
+      size_t row = (size_t)i*count + j0;
+      for(size_t j = 0; j != m; ++j) {
+        // Branch-free carries, so the loop can be vectorized.
+        bn_word s = a[row+j] + carry[j];
+        bn_word t = s + b[row+j];
+        carry[j] = (bn_word)(s < carry[j]) | (bn_word)(t < s);
+        r[row+j] = t;
+      }
     }
-    else if (a->array[i] < b->array[i])
-    {
-      return -1;
+    for(size_t j = 0; j != m; ++j) {
+      overflow |= carry[j];
     }
   }
-  while (i != 0);
-
-  return 0;
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
 }
 
-int bignum_greater(Bignum const* a, Bignum const* b)
+void bignum_soa_sub(bn_word* r, bn_word const* a, bn_word const* b, size_t count)
 {
-  bn_assert(a);
-  bn_assert(b);
-
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(a->array[i] <= b->array[i]) {
-      return 0;
+  bn_word overflow = 0;
+  for(size_t j0 = 0; j0 < count; j0 += bn__soa_block) {
+    size_t m = (count - j0 < bn__soa_block)? count - j0 : bn__soa_block;
+    bn_word borrow[bn__soa_block];
+    for(size_t j = 0; j != m; ++j) {
+      borrow[j] = 0;
     }
-  } while(i!=0);
-
-  return 1;
+    for(int i = 0; i != bn_array_size; ++i) {
+      size_t row = (size_t)i*count + j0;
+      for(size_t j = 0; j != m; ++j) {
+        bn_word x = a[row+j];
+        bn_word s = x - borrow[j];
+        bn_word t = s - b[row+j];
+        borrow[j] = (bn_word)(x < s) | (bn_word)(s < t);
+        r[row+j] = t;
+      }
+    }
+    for(size_t j = 0; j != m; ++j) {
+      overflow |= borrow[j];
+    }
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
 }
 
-int bignum_less(Bignum const* a, Bignum const* b)
+void bignum_soa_mul_u32(bn_word* r, bn_word const* a, uint32_t const* f, size_t count)
 {
-  bn_assert(a);
-  bn_assert(b);
-
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(a->array[i] >= b->array[i]) {
-      return 0;
+  bn_word overflow = 0;
+  for(size_t j0 = 0; j0 < count; j0 += bn__soa_block) {
+    size_t m = (count - j0 < bn__soa_block)? count - j0 : bn__soa_block;
+    bn_word carry[bn__soa_block];
+    for(size_t j = 0; j != m; ++j) {
+      carry[j] = 0;
     }
-  } while(i!=0);
-
-  return 1;
+    for(int i = 0; i != bn_array_size; ++i) {
+      size_t row = (size_t)i*count + j0;
+      for(size_t j = 0; j != m; ++j) {
+#if bn_word_bits == 32
+        uint64_t p = (uint64_t)a[row+j]*f[j0+j] + carry[j];
+        r[row+j] = (bn_word)p;
+        carry[j] = (bn_word)(p >> 32);
+#else
+        bn_word hi;
+        bn_word lo = bignum__mulw(a[row+j], f[j0+j], &hi);
+        lo += carry[j];
+        carry[j] = hi + (lo < carry[j]);
+        r[row+j] = lo;
+#endif
+      }
+    }
+    for(size_t j = 0; j != m; ++j) {
+      overflow |= carry[j];
+    }
+  }
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
 }
 
-int bignum_geq(Bignum const* a, Bignum const* b)
+// A product for `bignum__mul_task`. Each task of one level gets an entry
+// of an array of these.
+struct bn__mul_task
 {
-  bn_assert(a);
-  bn_assert(b);
+  bn_word *r;
+  bn_word const *a;
+  bn_word const *b;
+  int n;
+  int depth;
+  BignumPool const *pool;
+};
 
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(a->array[i] < b->array[i]) {
-      return 0;
-    }
-  } while(i!=0);
+static void bignum__mul_task(void *arg, size_t index);
 
-  return 1;
+// Same as `bignum__mul_karatsuba`, but the top `depth` levels run their
+// three products as tasks of `pool`. Every level keeps its differences and
+// the middle product on its own stack, the sequential levels below take
+// their scratch space from the stack of the worker.
+static void
+bignum__mul_karatsuba_parallel(bn_word *r, bn_word const *a, bn_word const *b,
+                               int n, int depth, BignumPool const *pool)
+{
+  if(depth == 0 || n < 2*bn_karatsuba_threshold) {
+    bn_word scratch[bn__karatsuba_scratch];
+    bignum__mul_karatsuba(r, a, b, n, scratch);
+    return;
+  }
+
+  int l = (n+1)/2;
+  int h = n - l;
+  bn_word da[bn_array_size];
+  bn_word db[bn_array_size];
+  bn_word m[2*bn_array_size];
+  bn_word t[2*bn_array_size+1];
+  int negative = bignum__absdiff(da, a, l, a+l, h);
+  negative ^= bignum__absdiff(db, b, l, b+l, h) ^ 1;
+
+  struct bn__mul_task tasks[3] = {
+    {r,     a,   b,   l, depth-1, pool},
+    {r+2*l, a+l, b+l, h, depth-1, pool},
+    {m,     da,  db,  l, depth-1, pool},
+  };
+  pool->run(pool->self, bignum__mul_task, tasks, 3);
+  bignum__karatsuba_combine(r, m, negative, n, t);
 }
 
-int bignum_leq(Bignum const* a, Bignum const* b)
+static void
+bignum__mul_task(void *arg, size_t index)
 {
-  bn_assert(a);
-  bn_assert(b);
+  struct bn__mul_task const *task = (struct bn__mul_task const *)arg + index;
+  bn__enter_task();
+  bignum__mul_karatsuba_parallel(task->r, task->a, task->b, task->n,
+                                 task->depth, task->pool);
+  bn__exit_task();
+}
 
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(a->array[i] > b->array[i]) {
-      return 0;
-    }
-  } while(i!=0);
+void bignum_mul_parallel(Bignum* res, Bignum const* lhs, Bignum const* rhs, BignumPool const* pool)
+{
+  bn_assert(res);
+  bn_assert(lhs);
+  bn_assert(rhs);
 
-  return 1;
+  bn__enter(bignum_op_mul_parallel, bignum__get_ndigits(lhs) + bignum__get_ndigits(rhs));
+
+  int an = bignum__secret_ndigits(lhs);
+  int bn = bignum__secret_ndigits(rhs);
+  if(an < bn) {
+    Bignum const *t = lhs;
+    lhs = rhs;
+    rhs = t;
+    int tn = an;
+    an = bn;
+    bn = tn;
+  }
+  if(pool == 0 || pool->workers <= 1 || bn < 2*bn_karatsuba_threshold) {
+    bignum_mul(res, lhs, rhs);
+    bn__exit(bignum_op_mul_parallel);
+    return;
+  }
+
+  // Every level multiplies the number of tasks by three.
+  int depth = 0;
+  for(int tasks = 1; tasks < pool->workers; tasks *= 3) {
+    depth += 1;
+  }
+
+  // Same as `bignum__mul_unbalanced`, with the bn-by-bn products run in
+  // parallel one after another.
+  bn_word const *a = lhs->array;
+  bn_word const *b = rhs->array;
+  bn_word wide[2*bn_array_size];
+  bn_word tmp[2*bn_array_size];
+  for(int i = 0; i != an+bn; ++i) {
+    wide[i] = 0;
+  }
+  int k = 0;
+  for(; k + bn <= an; k += bn) {
+    bignum__mul_karatsuba_parallel(tmp, a+k, b, bn, depth, pool);
+    bignum__add_into(wide+k, an+bn-k, tmp, 2*bn);
+  }
+  for(int i = k; i != an; ++i) {
+    wide[i+bn] = bignum__addmul_1(wide+i, b, bn, a[i]);
+  }
+
+  int used = an + bn;
+  int overflow = 0;
+  for(int i = bn_array_size; i < used; ++i) {
+    overflow |= (wide[i] != 0);
+  }
+  bignum__store(res, wide, (used < bn_array_size)? used : bn_array_size);
+  if(overflow != 0) {
+    bn_overflow_flag = 1;
+  }
+  bn__exit(bignum_op_mul_parallel);
 }
 
-int bignum_equal(Bignum const* a, Bignum const* b)
+struct bn__modexp_batch
 {
-  bn_assert(a);
-  bn_assert(b);
-
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(a->array[i] != b->array[i]) {
-      return 0;
-    }
-  } while(i!=0);
+  Bignum *res;
+  Bignum const *base;
+  Bignum const *exp;
+  BignumMont const *ctx;
+  size_t nctx;
+};
 
-  return 1;
+static void
+bignum__modexp_task(void *arg, size_t index)
+{
+  struct bn__modexp_batch const *batch = (struct bn__modexp_batch const *)arg;
+  BignumMont const *ctx = batch->ctx + ((batch->nctx == 1)? 0 : index);
+  bn__enter_task();
+  bignum_modexp(batch->res + index, batch->base + index, batch->exp + index, ctx);
+  bn__exit_task();
 }
 
-int bignum_is_zero(Bignum const* n)
+// The words of all the operands of a batch, as `bignum_modexp` counts them.
+static inline uint64_t
+bignum__modexp_batch_limbs(struct bn__modexp_batch const *batch, size_t count)
 {
-  bn_assert(n);
+  uint64_t limbs = 0;
+  for(size_t i = 0; i != count; ++i) {
+    BignumMont const *ctx = batch->ctx + ((batch->nctx == 1)? 0 : i);
+    limbs += (uint64_t)(ctx->ndigits + bignum__get_ndigits(batch->exp + i));
+  }
+  return limbs;
+}
 
-  int i = bn_array_size;
-  do {
-    -- i;
-    if(n->array[i] != 0) {
-      return 0;
+void bignum_modexp_batch(Bignum* res, Bignum const* base, Bignum const* exp, size_t count,
+                         BignumMont const* ctx, size_t nctx, BignumPool const* pool)
+{
+  bn_assert(res || count == 0);
+  bn_assert(base || count == 0);
+  bn_assert(exp || count == 0);
+  bn_assert(ctx);
+  bn_assert(nctx == 1 || nctx == count);
+
+  struct bn__modexp_batch batch = {res, base, exp, ctx, nctx};
+  bn__enter(bignum_op_modexp_batch, bignum__modexp_batch_limbs(&batch, count));
+  if(pool == 0 || pool->workers <= 1) {
+    for(size_t i = 0; i != count; ++i) {
+      bignum__modexp_task(&batch, i);
     }
-  } while(i!=0);
-
-  return 1;
+  }
+  else if(count != 0) {
+    pool->run(pool->self, bignum__modexp_task, &batch, count);
+  }
+  bn__exit(bignum_op_modexp_batch);
 }
 
 #endif
@@ -0,0 +1,548 @@
+#ifndef BIGNUM__HPP
+#define BIGNUM__HPP
+
+/*****************************************************************************
+
+Tiny bignum for C++ - fixed width unsigned integer templates on top of
+  bn.h, written in C++14.
+
+Licence: public domain.
+
+*****************************************************************************/
+
+#include "bn.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#if (defined(_MSVC_LANG) && _MSVC_LANG < 201402L) || \
+    (!defined(_MSVC_LANG) && __cplusplus < 201402L)
+  #error "bn.hpp requires C++14"
+#endif
+
+/*****************************************************************************
+  Fixed width integers
+
+  `tbn::uint<Bits>`  is an unsigned integer of `Bits` bits, which has to be
+  a multiple of bn_word_bits. It holds the words in `limbs`, the least
+  significant first, the same way Bignum holds them in `array`, and takes
+  no more space than that. All arithmetic wraps modulo 2**Bits like the
+  built-in unsigned types do, and there's no overflow flag.
+
+  The operations are constexpr, so constants such as moduli or the R**2 of
+  Montgomery arithmetic can be computed by the compiler:
+
+    constexpr auto m  = tbn::uint<256>::from_hex("ffffffff00000001...");
+    constexpr auto r2 = tbn::pow2_mod(512, m);
+
+  The word loops are over `words`, which is a constant of each
+  instantiation, so the compiler can unroll them for 128 and 256 bits. At
+  run  time,  with  C++20  or  a  compiler that has the builtin of
+  `std::is_constant_evaluated` (GCC 9, Clang 9 and newer), products of at
+  least  bn_karatsuba_threshold  words  and divisions go to `bignum_span_mul`
+  and `bignum_span_divmod` while the width fits bn_array_size. One file still has to define
+  `bn_implementation` before including bn.h or bn.hpp.
+
+  1. Construction
+    From  an  integer  of  up  to 64 bits, implicitly, or from another
+    width, explicitly, then the value is truncated or zero-extended.
+    `from_hex`  parses  a  string of hex digits, the value is truncated to
+    the lowest Bits bits. `from_bignum` and `to_bignum` convert to and
+    from  Bignum,  truncating  when the widths differ, and keep the cached
+    length valid with bn_track_length.
+
+  2. Operators
+    `+  -  *  /  %  &  |  ^  ~  <<  >>`,  their compound assignments, `++`,
+    `--` and the comparisons. The binary operators take any mix of uint
+    and integers. Division by zero is caught by bn_assert.
+
+  3. Fused multiply-add
+    `a*b`  doesn't  compute  the product right away, it returns a small
+    `product`  that holds references to the operands and turns into uint
+    when it's used. `a*b + c`, `c + a*b` and `c += a*b` add the products
+    straight into c, in one pass and without a temporary for the product.
+    `tbn::muladd(a, b, c)` does the same explicitly. As with other
+    expression templates, don't keep a product in an `auto` variable past
+    the end of the statement, it could refer to destroyed temporaries.
+
+  4. Other functions
+    `bit_length`,  `bit`  and  `to_u64`  are  members,  `tbn::divmod` stores
+    both the quotient and the remainder, `tbn::pow2_mod(k, m)` computes
+    2**k mod m.
+*****************************************************************************/
+
+namespace tbn {
+
+template<int Bits> class uint;
+
+namespace detail {
+
+// GCC 9 and Clang 9 have the builtin in every language mode. Without
+// either, everything takes the constexpr paths.
+#if defined(__cpp_lib_is_constant_evaluated)
+  #define bn__constant_evaluated() std::is_constant_evaluated()
+#elif defined(__has_builtin)
+  #if __has_builtin(__builtin_is_constant_evaluated)
+    #define bn__constant_evaluated() __builtin_is_constant_evaluated()
+  #endif
+#endif
+#if defined(bn__constant_evaluated)
+constexpr bool constant_evaluated() { return bn__constant_evaluated(); }
+#else
+constexpr bool constant_evaluated() { return true; }
+#endif
+
+#if bn_word_bits == 64 && defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 dword;
+#elif bn_word_bits == 32
+typedef uint64_t dword;
+#endif
+
+// Returns the low word of a*b, the high word is stored to `hi`.
+constexpr bn_word
+mulw(bn_word a, bn_word b, bn_word &hi)
+{
+#if bn_word_bits == 32 || defined(__SIZEOF_INT128__)
+  dword p = (dword)a * b;
+  hi = (bn_word)(p >> bn_word_bits);
+  return (bn_word)p;
+#else
+  // Products of the 32-bit halves, as in the portable code of bn.h.
+  uint64_t const m = UINT64_C(0xFFFFFFFF);
+  uint64_t ll = (a & m)*(b & m);
+  uint64_t lh = (a & m)*(b >> 32);
+  uint64_t hl = (a >> 32)*(b & m);
+  uint64_t hh = (a >> 32)*(b >> 32);
+  uint64_t mid = (ll >> 32) + (lh & m) + (hl & m);
+  hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  return (mid << 32) | (ll & m);
+#endif
+}
+
+// Returns the carry out of a + b + carry, the sum is stored to `sum`.
+constexpr bn_word
+addc(bn_word a, bn_word b, bn_word carry, bn_word &sum)
+{
+  bn_word s = a + b;
+  bn_word t = s + carry;
+  sum = t;
+  return (bn_word)(s < a) | (bn_word)(t < s);
+}
+
+// Returns the borrow out of a - b - borrow, the difference is stored to
+// `diff`.
+constexpr bn_word
+subb(bn_word a, bn_word b, bn_word borrow, bn_word &diff)
+{
+  bn_word d = a - b;
+  diff = d - borrow;
+  return (bn_word)(a < b) | (bn_word)(d < borrow);
+}
+
+constexpr int
+hex_value(char c)
+{
+  return (c >= '0' && c <= '9')? c - '0' :
+         (c >= 'a' && c <= 'f')? c - 'a' + 10 :
+         (c >= 'A' && c <= 'F')? c - 'A' + 10 : -1;
+}
+
+} // namespace detail
+
+template<int Bits>
+class uint
+{
+  static_assert(Bits > 0 && Bits % bn_word_bits == 0,
+                "the width must be a positive multiple of bn_word_bits");
+
+public:
+  static constexpr int words = Bits / bn_word_bits;
+
+  bn_word limbs[words];
+
+  // The unevaluated product of two values, see `operator*`.
+  struct product
+  {
+    uint const& a;
+    uint const& b;
+
+    constexpr operator uint() const { return uint::mul(a, b); }
+  };
+
+  constexpr uint() : limbs{} {}
+
+  constexpr uint(uint64_t v) : limbs{}
+  {
+    for(int i = 0; i != words && i*bn_word_bits < 64; ++i) {
+      limbs[i] = (bn_word)(v >> (i*bn_word_bits));
+    }
+  }
+
+  template<int OtherBits>
+  constexpr explicit uint(uint<OtherBits> const& v) : limbs{}
+  {
+    int n = (words < uint<OtherBits>::words)? words : uint<OtherBits>::words;
+    for(int i = 0; i != n; ++i) {
+      limbs[i] = v.limbs[i];
+    }
+  }
+
+  static constexpr uint
+  from_hex(char const* str)
+  {
+    bn_assert(str);
+    uint r;
+    for(; *str != 0; ++str) {
+      int v = detail::hex_value(*str);
+      bn_assert(v >= 0);
+      r <<= 4;
+      r.limbs[0] |= (bn_word)v;
+    }
+    return r;
+  }
+
+  static uint
+  from_bignum(Bignum const& n)
+  {
+    // The bytes go through the little-endian format of bn.h, which works
+    // for any bn_array_size. Truncating a wider value sets the overflow
+    // flag, it's restored as in `to_bignum`.
+    uint8_t bytes[Bits/8];
+    int overflow = bignum_is_overflow();
+    bytes_from_bignum(&n, bytes, sizeof(bytes), 0);
+    if(!overflow) bignum_reset_overflow_flag();
+    uint r;
+    for(int i = 0; i != Bits/8; ++i) {
+      r.limbs[i/(bn_word_bits/8)] |= (bn_word)bytes[i] << (8*(i % (bn_word_bits/8)));
+    }
+    return r;
+  }
+
+  Bignum
+  to_bignum() const
+  {
+    uint8_t bytes[Bits/8];
+    for(int i = 0; i != Bits/8; ++i) {
+      bytes[i] = (uint8_t)(limbs[i/(bn_word_bits/8)] >> (8*(i % (bn_word_bits/8))));
+    }
+    Bignum n;
+    bignum_init(&n);
+    int overflow = bignum_is_overflow();
+    bignum_from_bytes(&n, bytes, sizeof(bytes), 0);
+    if(!overflow) bignum_reset_overflow_flag();
+    return n;
+  }
+
+  constexpr uint64_t
+  to_u64() const
+  {
+    uint64_t v = 0;
+    for(int i = 0; i != words && i*bn_word_bits < 64; ++i) {
+      v |= (uint64_t)limbs[i] << (i*bn_word_bits);
+    }
+    return v;
+  }
+
+  constexpr explicit operator bool() const
+  {
+    bn_word any = 0;
+    for(int i = 0; i != words; ++i) {
+      any |= limbs[i];
+    }
+    return any != 0;
+  }
+
+  constexpr int
+  bit_length() const
+  {
+    for(int i = words; i-- != 0;) {
+      if(limbs[i] != 0) {
+        int bits = bn_word_bits;
+        while((limbs[i] >> (bits-1)) == 0) --bits;
+        return i*bn_word_bits + bits;
+      }
+    }
+    return 0;
+  }
+
+  constexpr bool
+  bit(int i) const
+  {
+    bn_assert(0 <= i && i < Bits);
+    return ((limbs[i/bn_word_bits] >> (i % bn_word_bits)) & 1) != 0;
+  }
+
+  // Compares `a` and `b`, returns -1, 0 or 1.
+  static constexpr int
+  cmp(uint const& a, uint const& b)
+  {
+    for(int i = words; i-- != 0;) {
+      if(a.limbs[i] != b.limbs[i]) {
+        return (a.limbs[i] > b.limbs[i])? 1 : -1;
+      }
+    }
+    return 0;
+  }
+
+  // Adds `b*a` to `r`, skipping the words of the products past the top.
+  // `r` is read while it's written, so it must not alias `a` or `b`.
+  static constexpr void
+  addmul(uint &r, uint const& a, uint const& b)
+  {
+    for(int i = 0; i != words; ++i) {
+      bn_word carry = 0;
+      for(int j = 0; j != words - i; ++j) {
+        bn_word hi = 0;
+        bn_word lo = detail::mulw(a.limbs[i], b.limbs[j], hi);
+        hi += detail::addc(lo, carry, 0, lo);
+        hi += detail::addc(lo, r.limbs[i+j], 0, r.limbs[i+j]);
+        carry = hi;
+      }
+    }
+  }
+
+  static constexpr uint
+  mul(uint const& a, uint const& b)
+  {
+    uint r;
+    if(!detail::constant_evaluated() &&
+       words >= bn_karatsuba_threshold && words <= bn_array_size) {
+      bn_word wide[2*words] = {};
+      bignum_span_mul(wide, a.limbs, words, b.limbs, words);
+      for(int i = 0; i != words; ++i) {
+        r.limbs[i] = wide[i];
+      }
+      return r;
+    }
+    addmul(r, a, b);
+    return r;
+  }
+
+  // Stores a/b to `q` and a%b to `r`. `q` and `r` may alias the operands.
+  static constexpr void
+  divmod(uint const& a, uint const& b, uint &q, uint &r)
+  {
+    bn_assert(b);
+    int bw = (b.bit_length() + bn_word_bits - 1)/bn_word_bits;
+    int aw = (a.bit_length() + bn_word_bits - 1)/bn_word_bits;
+    if(aw < bw) {
+      r = a;
+      q = uint();
+      return;
+    }
+    if(!detail::constant_evaluated() &&
+       bw <= bn_array_size && aw <= 2*bn_array_size+1) {
+      uint qt, rt;
+      bignum_span_divmod(qt.limbs, rt.limbs, a.limbs, aw, b.limbs, bw);
+      q = qt;
+      r = rt;
+      return;
+    }
+
+    // Restoring division, one bit at a time. The remainder is less than
+    // b, so when doubling it carries out of the top it's still above b,
+    // and the wrapped difference is the right one.
+    uint qt;
+    uint rt;
+    for(int i = a.bit_length(); i-- != 0;) {
+      bn_word out = rt.limbs[words-1] >> (bn_word_bits-1);
+      rt <<= 1;
+      rt.limbs[0] |= (bn_word)a.bit(i);
+      if(out != 0 || cmp(rt, b) >= 0) {
+        rt -= b;
+        qt.limbs[i/bn_word_bits] |= (bn_word)1 << (i % bn_word_bits);
+      }
+    }
+    q = qt;
+    r = rt;
+  }
+
+  constexpr uint& operator+=(uint const& b)
+  {
+    bn_word carry = 0;
+    for(int i = 0; i != words; ++i) {
+      carry = detail::addc(limbs[i], b.limbs[i], carry, limbs[i]);
+    }
+    return *this;
+  }
+
+  constexpr uint& operator-=(uint const& b)
+  {
+    bn_word borrow = 0;
+    for(int i = 0; i != words; ++i) {
+      borrow = detail::subb(limbs[i], b.limbs[i], borrow, limbs[i]);
+    }
+    return *this;
+  }
+
+  constexpr uint& operator+=(product const& p)
+  {
+    // In `x += x*y` the operand would change under the product.
+    if(&p.a == this || &p.b == this) {
+      uint const a = p.a;
+      uint const b = p.b;
+      addmul(*this, a, b);
+    }
+    else {
+      addmul(*this, p.a, p.b);
+    }
+    return *this;
+  }
+
+  constexpr uint& operator*=(uint const& b)
+  {
+    *this = mul(*this, b);
+    return *this;
+  }
+
+  constexpr uint& operator/=(uint const& b)
+  {
+    uint r;
+    divmod(*this, b, *this, r);
+    return *this;
+  }
+
+  constexpr uint& operator%=(uint const& b)
+  {
+    uint q;
+    divmod(*this, b, q, *this);
+    return *this;
+  }
+
+  constexpr uint& operator&=(uint const& b)
+  {
+    for(int i = 0; i != words; ++i) limbs[i] &= b.limbs[i];
+    return *this;
+  }
+
+  constexpr uint& operator|=(uint const& b)
+  {
+    for(int i = 0; i != words; ++i) limbs[i] |= b.limbs[i];
+    return *this;
+  }
+
+  constexpr uint& operator^=(uint const& b)
+  {
+    for(int i = 0; i != words; ++i) limbs[i] ^= b.limbs[i];
+    return *this;
+  }
+
+  constexpr uint& operator<<=(int nbits)
+  {
+    bn_assert(nbits >= 0);
+    if(nbits >= Bits) {
+      return *this = uint();
+    }
+    int w = nbits / bn_word_bits;
+    int s = nbits % bn_word_bits;
+    // The words are moved from the top down. The right shift by
+    // bn_word_bits-s is split in two, so that s = 0 is defined.
+    for(int i = words; i-- != 0;) {
+      bn_word hi = (i >= w)? limbs[i-w] : 0;
+      bn_word lo = (i > w)? limbs[i-w-1] : 0;
+      limbs[i] = (hi << s) | ((lo >> 1) >> (bn_word_bits-1-s));
+    }
+    return *this;
+  }
+
+  constexpr uint& operator>>=(int nbits)
+  {
+    bn_assert(nbits >= 0);
+    if(nbits >= Bits) {
+      return *this = uint();
+    }
+    int w = nbits / bn_word_bits;
+    int s = nbits % bn_word_bits;
+    for(int i = 0; i != words; ++i) {
+      bn_word lo = (i+w < words)? limbs[i+w] : 0;
+      bn_word hi = (i+w+1 < words)? limbs[i+w+1] : 0;
+      limbs[i] = (lo >> s) | ((hi << 1) << (bn_word_bits-1-s));
+    }
+    return *this;
+  }
+
+  constexpr uint& operator++() { return *this += uint(1); }
+  constexpr uint& operator--() { return *this -= uint(1); }
+  constexpr uint operator++(int) { uint t = *this; ++*this; return t; }
+  constexpr uint operator--(int) { uint t = *this; --*this; return t; }
+
+  // The operators are friends defined in the class, so products and
+  // integers convert to uint when they're passed to them.
+  friend constexpr uint operator+(uint a, uint const& b) { return a += b; }
+  friend constexpr uint operator-(uint a, uint const& b) { return a -= b; }
+  friend constexpr uint operator/(uint a, uint const& b) { return a /= b; }
+  friend constexpr uint operator%(uint a, uint const& b) { return a %= b; }
+  friend constexpr uint operator&(uint a, uint const& b) { return a &= b; }
+  friend constexpr uint operator|(uint a, uint const& b) { return a |= b; }
+  friend constexpr uint operator^(uint a, uint const& b) { return a ^= b; }
+  friend constexpr uint operator<<(uint a, int nbits) { return a <<= nbits; }
+  friend constexpr uint operator>>(uint a, int nbits) { return a >>= nbits; }
+
+  friend constexpr uint operator~(uint a)
+  {
+    for(int i = 0; i != words; ++i) a.limbs[i] = ~a.limbs[i];
+    return a;
+  }
+
+  friend constexpr product operator*(uint const& a, uint const& b)
+  {
+    return product{a, b};
+  }
+
+  friend constexpr uint operator+(product const& p, uint c) { return c += p; }
+  friend constexpr uint operator+(uint c, product const& p) { return c += p; }
+  friend constexpr uint operator+(product const& p, product const& q)
+  {
+    uint c = p;
+    return c += q;
+  }
+
+  friend constexpr bool operator==(uint const& a, uint const& b) { return cmp(a, b) == 0; }
+  friend constexpr bool operator!=(uint const& a, uint const& b) { return cmp(a, b) != 0; }
+  friend constexpr bool operator< (uint const& a, uint const& b) { return cmp(a, b) <  0; }
+  friend constexpr bool operator<=(uint const& a, uint const& b) { return cmp(a, b) <= 0; }
+  friend constexpr bool operator> (uint const& a, uint const& b) { return cmp(a, b) >  0; }
+  friend constexpr bool operator>=(uint const& a, uint const& b) { return cmp(a, b) >= 0; }
+};
+
+// Returns a*b + c, computed in one pass.
+template<int Bits>
+constexpr uint<Bits>
+muladd(uint<Bits> const& a, uint<Bits> const& b, uint<Bits> c)
+{
+  uint<Bits>::addmul(c, a, b);
+  return c;
+}
+
+template<int Bits>
+constexpr void
+divmod(uint<Bits> const& a, uint<Bits> const& b, uint<Bits> &q, uint<Bits> &r)
+{
+  uint<Bits>::divmod(a, b, q, r);
+}
+
+// Returns 2**k mod m, by doubling 1 k times. The doubled value is less
+// than 2m, so one subtraction reduces it, and a carry out of the top means
+// it's above m.
+template<int Bits>
+constexpr uint<Bits>
+pow2_mod(int k, uint<Bits> const& m)
+{
+  bn_assert(k >= 0);
+  bn_assert(m);
+  uint<Bits> r(1);
+  r %= m;
+  for(int i = 0; i != k; ++i) {
+    bn_word out = r.limbs[uint<Bits>::words-1] >> (bn_word_bits-1);
+    r <<= 1;
+    if(out != 0 || r >= m) {
+      r -= m;
+    }
+  }
+  return r;
+}
+
+} // namespace tbn
+
+#endif // BIGNUM__HPP
@@ -6,6 +6,14 @@ set CC=cl /TC /Z7 /I. /Wall /wd4820 /wd5045
 if "%1"=="test" (
   %CC% /LD -Dbn_array_size=4 -Dbn_test -Dbn_implementation bn.h /link /out:tests\tinybignum.dll
   py tests\tinybignum.py
+) else if "%1"=="bench" (
+  if not exist build mkdir build
+  set HEADER=--header
+  for %%s in (4 8 32 64 128) do (
+    %CC% /O2 /wd4710 /wd4711 -Dbn_array_size=%%s bench\bench.c /Fobuild\ /Febuild\bench_%%s.exe || exit /b 1
+    call build\bench_%%s.exe %%HEADER%% || exit /b 1
+    set HEADER=
+  )
 ) else (
   %CC% -Dbn_implementation -c bn.h -o build\bignum.obj
 )